@@ -84,9 +84,59 @@ struct statistic_map_t
 	{ "voluntary cs:", "Voluntary context switches:    " },
 #define	STAT_NICECS 14
 	{ "nice cs:     ", "Nice context switches:         " },
+#define	STAT_STREAMS 15
+	{ "streams:     ", "Parallel streams:              " },
+#define	STAT_TX_SQES 16
+	{ "tx-sqes:     ", "Submitted io_uring requests:   " },
+#define	STAT_TX_ZC 17
+	{ "tx-zerocopy: ", "Zero copy sends:               " },
+#define	STAT_STALLS 18
+	{ "stalls:      ", "Pipeline stalls:               " },
+#define	STAT_PIPE 19
+	{ "pipe:        ", "Splice pipe size:              " },
+#define	STAT_AUTO_CHUNK 20
+	{ "chunk:       ", "Chunk size (-b auto):          " },
+#define	STAT_MMSG 21
+	{ "datagrams:   ", "Datagrams:                     " },
+#define	STAT_GSO 22
+	{ "gso:         ", "UDP segmentation offload:      " },
+#define	STAT_GRO 23
+	{ "gro:         ", "UDP receive offload:           " },
+#define	STAT_RATE 24
+	{ "rate:        ", "Rate limit (--rate):           " },
+#define	STAT_SEQ 25
+	{ "sequence:    ", "Sequenced datagrams (-S):      " },
+#define	STAT_REORDER 26
+	{ "reorder:     ", "Reordering and jitter:         " },
+#define	STAT_NAK 27
+	{ "nak:         ", "NAK repair (-R):               " },
+#define	STAT_NAK_PEER 28
+	{ "nak-peer:    ", "  Receiver:                    " },
+#define	STAT_FEC 29
+	{ "fec:         ", "Forward error correction (-F): " },
+#define	STAT_RX_SQES 30
+	{ "rx-sqes:     ", "Submitted io_uring requests:   " },
+#define	STAT_PREALLOC 31
+	{ "prealloc:    ", "Preallocated output file:      " },
+#define	STAT_WRITE 32
+	{ "write:       ", "File writes:                   " },
+#define	STAT_SYNC 33
+	{ "sync:        ", "Final fsync:                   " },
+#define	STAT_RX_ZC 34
+	{ "rx-zerocopy: ", "Zero copy receive:             " },
+#define	STAT_LATENCY 35
+	{ "latency:     ", "RTT probe latency:             " },
+#define	STAT_CONN 36
+	{ "connection:  ", "Daemon connection:             " },
+#define	STAT_CONNS 37
+	{ "connections: ", "Daemon connections:            " },
 };
 
 
+/* receivers listed with their repair overhead (-R) */
+#define	NAK_STAT_PEERS 16
+
+
 /* unit stuff */
 struct unit_map_t
 {
@@ -163,11 +213,29 @@ static const char *io_call_to_str(enum io_call code)
 	case IO_MMAP: return "mmap";
 	case IO_RW: return "write";
 	case IO_SPLICE: return "splice";
+	case IO_URING: return "io_uring_enter";
 	}
 	return "";
 }
 
 
+/* the receive engine which ran */
+static const char *rx_call_to_str(void)
+{
+	if (opts.mmsg_batch || opts.udp_gro || net_stat.seq.enabled)
+		return "recvmmsg";
+	if (net_stat.total_rx_sqes)
+		return io_call_to_str(IO_URING);
+	if (net_stat.mmap_windows)
+		return io_call_to_str(IO_MMAP);
+	if (net_stat.pipe_size)
+		return io_call_to_str(IO_SPLICE);
+	if (net_stat.zc_rx_mapped || net_stat.zc_rx_copied)
+		return "getsockopt";
+	return "read";
+}
+
+
 #ifdef HAVE_RDTSCLL
 static unsigned long long
 tsc_diff(unsigned long long end, unsigned long long start)
@@ -185,7 +253,7 @@ tsc_diff(unsigned long long end, unsigned long long start)
 void
 gen_human_analyse(char *buf, unsigned int max_buf_len)
 {
-	int len, page_size;
+	int len, page_size, probe_round;
 	char unit_buf[UNIT_MAX];
 	struct timeval tv_tmp;
 	struct utsname utsname;
@@ -203,7 +271,8 @@ gen_human_analyse(char *buf, unsigned int max_buf_len)
 			utsname.nodename, utsname.release, utsname.machine);
 
 	if (opts.workmode == MODE_TRANSMIT) {
-		const char *tx_call_str = io_call_to_str(opts.io_call);
+		const char *tx_call_str = opts.mmsg_batch || opts.udp_seq ? "sendmmsg" :
+			io_call_to_str(opts.io_call);
 
 		/* display system call count */
 		len += xsnprintf(buf + len, max_buf_len - len, "%s %d (%s)\n",
@@ -228,11 +297,122 @@ gen_human_analyse(char *buf, unsigned int max_buf_len)
 		}
 		len += xsnprintf(buf + len, max_buf_len - len, "%s", "\n"); /* newline */
 
+		if (net_stat.total_tx_sqes)
+			len += xsnprintf(buf + len, max_buf_len - len, "%s %llu (%.2f per syscall)\n",
+					T2S(STAT_TX_SQES), net_stat.total_tx_sqes,
+					net_stat.total_tx_calls ?
+					(double) net_stat.total_tx_sqes / net_stat.total_tx_calls :
+					(double) net_stat.total_tx_sqes);
+
+		if (opts.io_flags & IOF_ZEROCOPY)
+			len += xsnprintf(buf + len, max_buf_len - len, "%s %llu (%llu copied by kernel)\n",
+					T2S(STAT_TX_ZC),
+					net_stat.total_tx_zc + net_stat.total_tx_zc_copied,
+					net_stat.total_tx_zc_copied);
+
+		if (opts.io_flags & IOF_PIPELINE)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s reader %llu (ring full), sender %llu (ring empty)\n",
+					T2S(STAT_STALLS), net_stat.ring_full_stalls,
+					net_stat.ring_empty_stalls);
+
+		/* rtt probes (-r), with --busy-poll one round without and one with */
+		for (probe_round = 0; probe_round < 2; probe_round++) {
+			const struct latency_dist *ld = &net_stat.latency[probe_round];
+
+			if (!ld->samples)
+				continue;
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, max %.1f us "
+					"(%u probes", T2S(STAT_LATENCY), ld->min, ld->p50, ld->p90,
+					ld->p99, ld->max, ld->samples);
+			if (opts.busy_poll_usec && probe_round == 0)
+				len += xsnprintf(buf + len, max_buf_len - len, ", no busy poll");
+			if (probe_round == 1)
+				len += xsnprintf(buf + len, max_buf_len - len,
+						", busy poll %u us%s, p50 %+.1f us", opts.busy_poll_usec,
+						opts.busy_poll_spin ? " and spin" : "",
+						ld->p50 - net_stat.latency[0].p50);
+			len += xsnprintf(buf + len, max_buf_len - len, ")\n");
+		}
+
+		if (net_stat.pipe_size)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %u Byte (%.1f splice calls/GiB)\n",
+					T2S(STAT_PIPE), net_stat.pipe_size,
+					net_stat.total_tx_bytes ? (double) net_stat.splice_calls /
+					((double) net_stat.total_tx_bytes / (1 << 30)) : 0.0);
+
+		if (net_stat.auto_chunk)
+			len += xsnprintf(buf + len, max_buf_len - len, "%s %u Byte (auto)\n",
+					T2S(STAT_AUTO_CHUNK), net_stat.auto_chunk);
+
+		if (net_stat.total_tx_msgs)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu (%.2f per call, batch fill %.1f%%)\n",
+					T2S(STAT_MMSG), net_stat.total_tx_msgs,
+					net_stat.total_tx_calls ?
+					(double) net_stat.total_tx_msgs / net_stat.total_tx_calls : 0.0,
+					net_stat.total_tx_calls ? 100.0 * net_stat.total_tx_msgs /
+					((double) net_stat.total_tx_calls *
+					 (opts.mmsg_batch ? opts.mmsg_batch : 1)) : 0.0);
+
+		if (net_stat.gso_size) {
+			/* one datagram per write, with -M one per message */
+			unsigned long long sends = net_stat.total_tx_msgs ?
+				net_stat.total_tx_msgs : net_stat.total_tx_calls;
+
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %u Byte segments, %llu super-sends (%.1f segments each)\n",
+					T2S(STAT_GSO), net_stat.gso_size, sends, sends ?
+					(double) net_stat.total_tx_bytes / net_stat.gso_size / sends : 0.0);
+		}
+
+		if (opts.fec.type != FEC_NONE)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %s %u+%u, %llu parity datagrams (%.2f%% overhead)\n",
+					T2S(STAT_FEC), fec_type_str(opts.fec.type), opts.fec.n, opts.fec.k,
+					net_stat.fec.parity, net_stat.total_tx_msgs ?
+					100.0 * net_stat.fec.parity / net_stat.total_tx_msgs : 0.0);
+
+		if (opts.nak_receivers) {
+			const struct nak_stat *nk = &net_stat.nak;
+			unsigned int i;
+
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %u of %u receivers complete, %u rounds, %llu NAKs, "
+					"%llu repairs (%.2f%% of %llu datagrams)\n",
+					T2S(STAT_NAK), nk->acked, opts.nak_receivers, nk->rounds,
+					nk->naks, nk->repairs, net_stat.total_tx_msgs ?
+					100.0 * nk->repairs / net_stat.total_tx_msgs : 0.0,
+					net_stat.total_tx_msgs);
+
+			/* the repair overhead every receiver caused */
+			for (i = 0; i < nk->npeers && i < NAK_STAT_PEERS; i++) {
+				const struct nak_peer *p = &nk->peer[i];
+				char done[32];
+
+				if (p->done_round)
+					xsnprintf(done, sizeof(done), "complete in round %u", p->done_round);
+				else
+					xsnprintf(done, sizeof(done), "incomplete");
+
+				len += xsnprintf(buf + len, max_buf_len - len,
+						"%s %s %llu NAKs, %llu datagrams (%.2f%%), %s\n",
+						T2S(STAT_NAK_PEER), p->addr, p->naks, p->requested,
+						net_stat.total_tx_msgs ?
+						100.0 * p->requested / net_stat.total_tx_msgs : 0.0, done);
+			}
+			if (nk->npeers > NAK_STAT_PEERS)
+				len += xsnprintf(buf + len, max_buf_len - len, "%s ... %u more\n",
+						T2S(STAT_NAK_PEER), nk->npeers - NAK_STAT_PEERS);
+		}
+
 	} else { /* MODE_RECEIVE */
 		/* display system call count */
-		len += xsnprintf(buf + len, max_buf_len - len, "%s %d (read)\n",
+		len += xsnprintf(buf + len, max_buf_len - len, "%s %d (%s)\n",
 				T2S(STAT_RX_CALLS),
-				net_stat.total_rx_calls);
+				net_stat.total_rx_calls, rx_call_to_str());
 
 		/* display data amount */
 		len += xsnprintf(buf + len, max_buf_len - len, "%s %llu %s",
@@ -251,8 +431,130 @@ gen_human_analyse(char *buf, unsigned int max_buf_len)
 			}
 		}
 		len += xsnprintf(buf + len, max_buf_len - len, "%s", ")\n"); /* newline */
+
+		if (opts.rx_daemon)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu complete, %llu incomplete, %llu rejected, "
+					"at most %u concurrent\n",
+					T2S(STAT_CONNS), net_stat.conn_complete,
+					net_stat.conn_incomplete, net_stat.conn_rejected,
+					net_stat.conn_peak);
+
+		if (net_stat.total_rx_sqes)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu (%.2f per syscall), %llu recv completions, "
+					"buffer ring empty %llu times\n",
+					T2S(STAT_RX_SQES), net_stat.total_rx_sqes,
+					net_stat.total_rx_calls ?
+					(double) net_stat.total_rx_sqes / net_stat.total_rx_calls :
+					(double) net_stat.total_rx_sqes,
+					net_stat.uring_recvs, net_stat.uring_nobufs);
+
+		if (net_stat.zc_rx_mapped || net_stat.zc_rx_copied)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu Byte mapped (%.1f%%), %llu Byte copied\n",
+					T2S(STAT_RX_ZC), net_stat.zc_rx_mapped,
+					net_stat.total_rx_bytes ? 100.0 * net_stat.zc_rx_mapped /
+					net_stat.total_rx_bytes : 0.0, net_stat.zc_rx_copied);
+
+		if (opts.io_flags & IOF_PIPELINE)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s reader %llu (ring full, storage bound), "
+					"writer %llu (ring empty, network bound)\n",
+					T2S(STAT_STALLS), net_stat.ring_full_stalls,
+					net_stat.ring_empty_stalls);
+
+		if (net_stat.prealloc || net_stat.mmap_windows)
+			len += xsnprintf(buf + len, max_buf_len - len, "%s %llu Byte%s",
+					T2S(STAT_PREALLOC), net_stat.prealloc,
+					net_stat.mmap_windows ? ", " : "\n");
+		if (net_stat.mmap_windows)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"received into %llu mmap windows\n", net_stat.mmap_windows);
+
+		/* the streams write in parallel, their write times add up */
+		if (net_stat.write_ns) {
+			double write_sec = (double) net_stat.write_ns / 1000000000 /
+				(net_stat.streams ? net_stat.streams : 1);
+
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %.4f sec, %.2f MiB/s%s\n",
+					T2S(STAT_WRITE), write_sec,
+					(double) net_stat.total_rx_bytes / write_sec / (1 << 20),
+					opts.io_flags & IOF_DIRECT ? " (O_DIRECT)" :
+					opts.io_flags & IOF_DONTCACHE ? " (RWF_DONTCACHE)" : "");
+		}
+		/* durable: the received data is on stable storage */
+		if (opts.outfile && strcmp(opts.outfile, "-") && timerisset(&net_stat.durable)) {
+			double durable;
+
+			subtime(&net_stat.durable, &net_stat.use_stat_start.time, &tv_tmp);
+			durable = tv_tmp.tv_sec + ((double) tv_tmp.tv_usec) / 1000000;
+			if (durable <= 0.0)
+				durable = 0.00001;
+
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s final fsync %.4f sec, durable after %.4f sec (%.2f MiB/s)",
+					T2S(STAT_SYNC), (double) net_stat.sync_ns / 1000000000,
+					durable, (double) net_stat.total_rx_bytes / durable / (1 << 20));
+			if (net_stat.sync_windows)
+				len += xsnprintf(buf + len, max_buf_len - len,
+						", %llu windows written back (%.4f sec)",
+						net_stat.sync_windows, (double) net_stat.writeback_ns / 1000000000);
+			len += xsnprintf(buf + len, max_buf_len - len, "\n");
+		}
+
+		if (net_stat.pipe_size)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %u Byte (%.1f splice calls/GiB)\n",
+					T2S(STAT_PIPE), net_stat.pipe_size,
+					net_stat.total_rx_bytes ? (double) net_stat.splice_calls /
+					((double) net_stat.total_rx_bytes / (1 << 30)) : 0.0);
+
+		if (net_stat.total_rx_msgs)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu (%.2f per call)\n",
+					T2S(STAT_MMSG), net_stat.total_rx_msgs,
+					net_stat.total_rx_calls ?
+					(double) net_stat.total_rx_msgs / net_stat.total_rx_calls : 0.0);
+
+		if (opts.udp_gro)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %u Byte segments, %llu coalesced reads\n",
+					T2S(STAT_GRO), net_stat.gso_size, net_stat.gro_reads);
+
+		if (net_stat.seq.enabled) {
+			const struct seq_stat *ss = &net_stat.seq;
+
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu of %llu received, %llu lost (%.3f%%), %llu duplicates, %llu late%s\n",
+					T2S(STAT_SEQ), ss->received, ss->expected, ss->lost,
+					ss->expected ? 100.0 * ss->lost / ss->expected : 0.0,
+					ss->dups, ss->late, ss->end_seen ? "" : " (no end marker, idle timeout)");
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu reordered (max distance %llu), longest loss burst %llu, jitter %.1f us\n",
+					T2S(STAT_REORDER), ss->reordered, ss->reorder_max,
+					ss->gap_max, ss->jitter_us);
+		}
+
+		if (net_stat.fec.parity)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %llu parity datagrams, %llu datagrams recovered, "
+					"%llu unrecoverable blocks\n",
+					T2S(STAT_FEC), net_stat.fec.parity, net_stat.fec.recovered,
+					net_stat.fec.unrecoverable);
+
+		if (net_stat.nak.rounds)
+			len += xsnprintf(buf + len, max_buf_len - len,
+					"%s %u rounds, %llu NAKs sent, %llu repairs, %llu duplicate repairs\n",
+					T2S(STAT_NAK), net_stat.nak.rounds, net_stat.nak.naks,
+					net_stat.nak.repairs, net_stat.nak.repair_dups);
 	}
 
+	if (net_stat.streams > 1)
+		len += xsnprintf(buf + len, max_buf_len - len, "%s %u\n",
+				T2S(STAT_STREAMS), net_stat.streams);
+
 	subtime(&net_stat.use_stat_end.time, &net_stat.use_stat_start.time, &tv_tmp);
 	total_real = tv_tmp.tv_sec + ((double) tv_tmp.tv_usec) / 1000000;
 	if (total_real <= 0.0)
@@ -341,6 +643,36 @@ gen_human_analyse(char *buf, unsigned int max_buf_len)
 		len += xsnprintf(buf + len, max_buf_len - len, "%s", ")"); /* newline */
 	}
 	len += xsnprintf(buf + len, max_buf_len - len, "%s", "\n");
+
+	/* configured vs. achieved rate, both in bit/s */
+	if (opts.workmode == MODE_TRANSMIT && opts.rate)
+		len += xsnprintf(buf + len, max_buf_len - len,
+				"%s %.3f Mbit/s configured, %.3f Mbit/s achieved, burst %u Byte%s\n",
+				T2S(STAT_RATE), opts.rate / 1e6, throughput * 8 / 1e6,
+				net_stat.rate_burst, net_stat.rate_kernel ? ", kernel pacing" : "");
+}
+
+
+/* one line per sender of the receive daemon (--daemon): peer,
+** output file, data amount, throughput and the final fsync
+*/
+void
+gen_conn_analyse(char *buf, unsigned int max_buf_len, const char *peer,
+		const char *path, const struct net_stat *ns)
+{
+	struct timeval end = ns->use_stat_end.time, start = ns->use_stat_start.time;
+	struct timeval tv_tmp;
+	double real;
+
+	subtime(&end, &start, &tv_tmp);
+	real = tv_tmp.tv_sec + ((double) tv_tmp.tv_usec) / 1000000;
+	if (real <= 0.0)
+		real = 0.00001;
+
+	xsnprintf(buf, max_buf_len, "%s %s -> %s, %llu Byte in %.4f sec "
+			"(%.2f MiB/s), fsync %.4f sec\n", T2S(STAT_CONN), peer, path,
+			ns->total_rx_bytes, real, (double) ns->total_rx_bytes / real / (1 << 20),
+			(double) ns->sync_ns / 1000000000);
 }
 
 #undef T2S
@@ -372,7 +704,7 @@ gen_machine_analyse(char *buf, unsigned int max_buf_len)
 	if (opts.workmode == MODE_TRANSMIT)
 		call_str = io_call_to_str(opts.io_call);
 	else
-		call_str = "read";
+		call_str = rx_call_to_str();
 	len += xsnprintf(buf + len, max_buf_len - len, "%s ", call_str);
 
 	/* memory advise */
@@ -451,6 +783,55 @@ gen_machine_analyse(char *buf, unsigned int max_buf_len)
 }
 
 
+/* fold the statistic of one stream into dst: counters are
+** summed up, the measurement interval spans from the earliest
+** start to the latest end of all streams
+*/
+void
+net_stat_merge(struct net_stat *dst, const struct net_stat *src)
+{
+	dst->total_rx_calls += src->total_rx_calls;
+	dst->total_rx_bytes += src->total_rx_bytes;
+	dst->total_tx_calls += src->total_tx_calls;
+	dst->total_tx_bytes += src->total_tx_bytes;
+	dst->total_tx_sqes += src->total_tx_sqes;
+	dst->total_rx_sqes += src->total_rx_sqes;
+	dst->uring_recvs += src->uring_recvs;
+	dst->uring_nobufs += src->uring_nobufs;
+	dst->prealloc += src->prealloc;
+	dst->mmap_windows += src->mmap_windows;
+	dst->write_ns += src->write_ns;
+	dst->sync_windows += src->sync_windows;
+	dst->writeback_ns += src->writeback_ns;
+	dst->zc_rx_mapped += src->zc_rx_mapped;
+	dst->zc_rx_copied += src->zc_rx_copied;
+	dst->total_tx_zc += src->total_tx_zc;
+	dst->total_tx_zc_copied += src->total_tx_zc_copied;
+	dst->ring_full_stalls += src->ring_full_stalls;
+	dst->ring_empty_stalls += src->ring_empty_stalls;
+	dst->splice_calls += src->splice_calls;
+	dst->total_tx_msgs += src->total_tx_msgs;
+	dst->total_rx_msgs += src->total_rx_msgs;
+	dst->gso_size = max(dst->gso_size, src->gso_size);
+	dst->gro_reads += src->gro_reads;
+	dst->rate_burst = max(dst->rate_burst, src->rate_burst);
+	dst->rate_kernel |= src->rate_kernel;
+	dst->pipe_size = max(dst->pipe_size, src->pipe_size);
+	if (dst->auto_chunk == 0)
+		dst->auto_chunk = src->auto_chunk;
+
+	if (dst->sock_stat.mss == 0)
+		dst->sock_stat = src->sock_stat;
+
+	if (!timerisset(&dst->use_stat_start.time) ||
+		TIME_LT((&src->use_stat_start.time), (&dst->use_stat_start.time)))
+		dst->use_stat_start = src->use_stat_start;
+
+	if (TIME_GT((&src->use_stat_end.time), (&dst->use_stat_end.time)))
+		dst->use_stat_end = src->use_stat_end;
+}
+
+
 int
 subtime(struct timeval *op1, struct timeval *op2, struct timeval *result)
 {
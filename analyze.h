@@ -22,8 +22,13 @@
 ** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
+struct net_stat;
+
 void gen_human_analyse(char *, unsigned int);
 void gen_machine_analyse(char *, unsigned int);
+void net_stat_merge(struct net_stat *, const struct net_stat *);
+void gen_conn_analyse(char *, unsigned int, const char *, const char *,
+		const struct net_stat *);
 long sublong(long, long);
 
 #define TIME_GT(x,y) (x->tv_sec > y->tv_sec || (x->tv_sec == y->tv_sec && x->tv_usec > y->tv_usec))
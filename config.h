@@ -0,0 +1,12 @@
+/* Generated config.h see configure script for further information */
+#define HAVE_ALLOCA 1
+/* uncomment if you know TSC to be stable on this system */
+/* #define HAVE_RDTSCLL 1 */
+#define HAVE_SPLICE 1
+#define HAVE_FALLOCATE 1
+#define HAVE_SYNC_FILE_RANGE 1
+#define HAVE_AF_TIPC 1
+#define HAVE_IO_URING 1
+#define HAVE_X86_SIMD 1
+#define HAVE_TCP_MD5SIG 1
+#define HAVE_TCP_ZEROCOPY_RECEIVE 1
@@ -0,0 +1,519 @@
+/*
+** netsend - a high performance filetransfer and diagnostic tool
+** http://netsend.berlios.de
+**
+**
+** Copyright (C) 2006 - Hagen Paul Pfeifer <hagen@jauu.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+#include "global.h"
+#include "xfuncs.h"
+#include "fec.h"
+
+/* receive window: enough blocks to cover reordering, bounded in memory */
+#define	FEC_WINDOW_BYTES (32 * 1024 * 1024)
+#define	FEC_WINDOW_MIN 4
+#define	FEC_WINDOW_MAX 256
+
+
+/* GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d) */
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+static bool gf_ready;
+
+static void gf_init(void)
+{
+	unsigned int i, x = 1;
+
+	if (gf_ready)
+		return;
+
+	for (i = 0; i < 255; i++) {
+		gf_exp[i] = gf_exp[i + 255] = x;
+		gf_log[x] = i;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= 0x11d;
+	}
+	gf_ready = true;
+}
+
+
+static inline uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+	if (a == 0 || b == 0)
+		return 0;
+	return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+
+static inline uint8_t gf_inv(uint8_t a)
+{
+	return gf_exp[255 - gf_log[a]];
+}
+
+
+/* coefficient of data datagram j in parity datagram i: all ones
+** for xor, for rs the Cauchy matrix 1 / (x_i + y_j) with x_i = n + i
+** and y_j = j - every square submatrix of it is invertible */
+static uint8_t fec_coef(const struct fec_code *code, unsigned int i, unsigned int j)
+{
+	if (code->type == FEC_XOR)
+		return 1;
+	return gf_inv((code->n + i) ^ j);
+}
+
+
+/* Region operations: dst ^= c * src. The multiplication splits
+** every byte into two nibbles and looks both up in 16 entry tables,
+** which is exactly what pshufb does for 16 (SSSE3) respective 32
+** (AVX2) bytes at once. The generic variant uses the log tables.
+*/
+static void region_mul_add_generic(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	size_t i;
+
+	if (c == 1) {
+		for (i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+			uint64_t a, b;
+
+			memcpy(&a, dst + i, sizeof(a));
+			memcpy(&b, src + i, sizeof(b));
+			a ^= b;
+			memcpy(dst + i, &a, sizeof(a));
+		}
+		for (; i < len; i++)
+			dst[i] ^= src[i];
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+		dst[i] ^= gf_mul(c, src[i]);
+}
+
+
+#ifdef HAVE_X86_SIMD
+static void nibble_tables(uint8_t c, uint8_t lo[16], uint8_t hi[16])
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		lo[i] = gf_mul(c, i);
+		hi[i] = gf_mul(c, i << 4);
+	}
+}
+
+
+__attribute__((target("ssse3")))
+static void region_mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	uint8_t lo[16], hi[16];
+	__m128i tlo, thi, mask = _mm_set1_epi8(0x0f);
+	size_t i;
+
+	nibble_tables(c, lo, hi);
+	tlo = _mm_loadu_si128((const __m128i *) lo);
+	thi = _mm_loadu_si128((const __m128i *) hi);
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+		__m128i l = _mm_shuffle_epi8(tlo, _mm_and_si128(s, mask));
+		__m128i h = _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+
+		d = _mm_xor_si128(d, _mm_xor_si128(l, h));
+		_mm_storeu_si128((__m128i *) (dst + i), d);
+	}
+	region_mul_add_generic(dst + i, src + i, c, len - i);
+}
+
+
+__attribute__((target("avx2")))
+static void region_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	uint8_t lo[16], hi[16];
+	__m256i tlo, thi, mask = _mm256_set1_epi8(0x0f);
+	size_t i;
+
+	nibble_tables(c, lo, hi);
+	tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) lo));
+	thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) hi));
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+		__m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+		__m256i l = _mm256_shuffle_epi8(tlo, _mm256_and_si256(s, mask));
+		__m256i h = _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+
+		d = _mm256_xor_si256(d, _mm256_xor_si256(l, h));
+		_mm256_storeu_si256((__m256i *) (dst + i), d);
+	}
+	region_mul_add_generic(dst + i, src + i, c, len - i);
+}
+#endif /* HAVE_X86_SIMD */
+
+
+static void (*region_mul_add)(uint8_t *, const uint8_t *, uint8_t, size_t);
+
+static void fec_init(void)
+{
+	if (region_mul_add)
+		return;
+
+	gf_init();
+	region_mul_add = region_mul_add_generic;
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		region_mul_add = region_mul_add_avx2;
+	else if (__builtin_cpu_supports("ssse3"))
+		region_mul_add = region_mul_add_ssse3;
+#endif
+	msg(STRESSFUL, "fec: %s region operations",
+			region_mul_add == region_mul_add_generic ? "generic" :
+#ifdef HAVE_X86_SIMD
+			region_mul_add == region_mul_add_avx2 ? "avx2" :
+#endif
+			"ssse3");
+}
+
+
+const char *fec_type_str(enum fec_type type)
+{
+	switch (type) {
+	case FEC_XOR:
+		return "xor";
+	case FEC_RS:
+		return "rs";
+	case FEC_NONE:
+	default:
+		return "none";
+	}
+}
+
+
+void fec_tx_init(struct fec_tx *tx, const struct fec_code *code, size_t seg)
+{
+	unsigned int i;
+
+	fec_init();
+
+	memset(tx, 0, sizeof(*tx));
+	tx->code = *code;
+	tx->seg = seg;
+	tx->parity = xmalloc(code->k * sizeof(*tx->parity));
+	for (i = 0; i < code->k; i++)
+		tx->parity[i] = xzalloc(seg);
+}
+
+
+/* fold the next data datagram of the block into the parity */
+void fec_tx_add(struct fec_tx *tx, const unsigned char *data, size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < tx->code.k; i++)
+		region_mul_add(tx->parity[i], data, fec_coef(&tx->code, i, tx->count), len);
+
+	tx->tail_len = len;
+	tx->count++;
+}
+
+
+/* the parity of the block is sent, start the next one */
+void fec_tx_next(struct fec_tx *tx)
+{
+	unsigned int i;
+
+	for (i = 0; i < tx->code.k; i++)
+		memset(tx->parity[i], 0, tx->seg);
+
+	tx->block++;
+	tx->count = 0;
+	tx->tail_len = 0;
+}
+
+
+void fec_tx_free(struct fec_tx *tx)
+{
+	unsigned int i;
+
+	for (i = 0; i < tx->code.k; i++)
+		free(tx->parity[i]);
+	free(tx->parity);
+}
+
+
+/* A block under reconstruction holds copies of its n data and k
+** parity datagrams. count is the number of data datagrams of the
+** block - n unless a parity datagram told otherwise for the last
+** block of the file.
+*/
+struct fec_rx_block {
+	unsigned long long block;
+	bool used;
+	bool done;
+	unsigned int count;
+	size_t tail_len;
+	unsigned int ndata, nparity;
+	unsigned char have[(FEC_MAX_N + FEC_MAX_K + 7) / 8];
+	unsigned char *buf; /* < n + k slots of seg bytes */
+};
+
+
+static bool blk_has(const struct fec_rx_block *b, unsigned int slot)
+{
+	return b->have[slot >> 3] & (1 << (slot & 7));
+}
+
+
+void fec_rx_init(struct fec_rx *rx, const struct fec_code *code, size_t seg,
+		fec_deliver_t deliver, void *ctx)
+{
+	size_t blksize = (code->n + code->k) * seg;
+	unsigned int i;
+
+	fec_init();
+
+	memset(rx, 0, sizeof(*rx));
+	rx->code = *code;
+	rx->seg = seg;
+	rx->deliver = deliver;
+	rx->ctx = ctx;
+
+	rx->window = FEC_WINDOW_BYTES / blksize;
+	rx->window = max(rx->window, (unsigned int) FEC_WINDOW_MIN);
+	rx->window = min(rx->window, (unsigned int) FEC_WINDOW_MAX);
+
+	rx->blocks = xzalloc(rx->window * sizeof(*rx->blocks));
+	rx->mem = xmalloc(rx->window * blksize);
+	for (i = 0; i < rx->window; i++)
+		rx->blocks[i].buf = rx->mem + i * blksize;
+
+	msg(GENTLE, "fec %s %u+%u, %zu byte segments, window of %u blocks",
+			fec_type_str(code->type), code->n, code->k, seg, rx->window);
+}
+
+
+/* rebuild the missing data datagrams of a block from the parity:
+** subtract the present data from e received parity datagrams and
+** solve the e x e system of the missing columns (Gauss-Jordan) */
+static void fec_rx_decode(struct fec_rx *rx, struct fec_rx_block *b)
+{
+	const struct fec_code *code = &rx->code;
+	unsigned int miss[FEC_MAX_K], par[FEC_MAX_K];
+	uint8_t a[FEC_MAX_K][FEC_MAX_K], inv[FEC_MAX_K][FEC_MAX_K];
+	unsigned int e = 0, p = 0, i, j, r, c;
+	unsigned char *out;
+
+	for (j = 0; j < b->count; j++) {
+		if (!blk_has(b, j))
+			miss[e++] = j;
+	}
+	for (i = 0; i < code->k && p < e; i++) {
+		if (blk_has(b, code->n + i))
+			par[p++] = i;
+	}
+
+	/* syndromes: parity minus the contribution of the present data */
+	for (r = 0; r < e; r++) {
+		unsigned char *s = b->buf + (code->n + par[r]) * rx->seg;
+
+		for (j = 0; j < b->count; j++) {
+			if (blk_has(b, j))
+				region_mul_add(s, b->buf + j * rx->seg,
+						fec_coef(code, par[r], j), rx->seg);
+		}
+		for (c = 0; c < e; c++) {
+			a[r][c] = fec_coef(code, par[r], miss[c]);
+			inv[r][c] = r == c;
+		}
+	}
+
+	for (c = 0; c < e; c++) {
+		uint8_t f;
+
+		for (r = c; r < e && a[r][c] == 0; r++)
+			;
+		if (r == e)
+			return; /* can't happen for a Cauchy matrix */
+		if (r != c) {
+			for (j = 0; j < e; j++) {
+				uint8_t t = a[r][j]; a[r][j] = a[c][j]; a[c][j] = t;
+				t = inv[r][j]; inv[r][j] = inv[c][j]; inv[c][j] = t;
+			}
+		}
+		f = gf_inv(a[c][c]);
+		for (j = 0; j < e; j++) {
+			a[c][j] = gf_mul(a[c][j], f);
+			inv[c][j] = gf_mul(inv[c][j], f);
+		}
+		for (r = 0; r < e; r++) {
+			if (r == c || a[r][c] == 0)
+				continue;
+			f = a[r][c];
+			for (j = 0; j < e; j++) {
+				a[r][j] ^= gf_mul(f, a[c][j]);
+				inv[r][j] ^= gf_mul(f, inv[c][j]);
+			}
+		}
+	}
+
+	for (c = 0; c < e; c++) {
+		size_t len = miss[c] == b->count - 1 ? b->tail_len : rx->seg;
+
+		out = b->buf + miss[c] * rx->seg;
+		memset(out, 0, rx->seg);
+		for (r = 0; r < e; r++)
+			region_mul_add(out, b->buf + (code->n + par[r]) * rx->seg, inv[c][r], rx->seg);
+
+		b->have[miss[c] >> 3] |= 1 << (miss[c] & 7);
+		rx->recovered++;
+		rx->deliver(rx->ctx, b->block * code->n + miss[c], out, len);
+	}
+}
+
+
+static void fec_rx_try(struct fec_rx *rx, struct fec_rx_block *b)
+{
+	if (b->done || b->count == 0)
+		return;
+
+	if (b->ndata >= b->count) {
+		b->done = true;
+		return;
+	}
+
+	/* the tail length of a short last datagram comes with the parity */
+	if (b->nparity && b->ndata + b->nparity >= b->count) {
+		fec_rx_decode(rx, b);
+		b->done = true;
+	}
+}
+
+
+static void fec_rx_retire(struct fec_rx *rx, struct fec_rx_block *b)
+{
+	if (b->used && !b->done && b->ndata < b->count)
+		rx->unrecoverable++;
+	b->used = false;
+}
+
+
+static struct fec_rx_block *fec_rx_block_get(struct fec_rx *rx, unsigned long long block)
+{
+	struct fec_rx_block *b = &rx->blocks[block % rx->window];
+
+	if (b->used && b->block == block)
+		return b;
+
+	/* too old, its slot was already reused */
+	if (b->used && b->block > block)
+		return NULL;
+
+	fec_rx_retire(rx, b);
+	memset(b->have, 0, sizeof(b->have));
+	memset(b->buf, 0, (rx->code.n + rx->code.k) * rx->seg);
+	b->block = block;
+	b->used = true;
+	b->done = false;
+	b->count = rx->code.n;
+	b->tail_len = rx->seg;
+	b->ndata = b->nparity = 0;
+	return b;
+}
+
+
+/* returns false if the datagram is already known - e.g. rebuilt */
+bool fec_rx_data(struct fec_rx *rx, unsigned long long seq,
+		const unsigned char *data, size_t len)
+{
+	unsigned int slot = seq % rx->code.n;
+	struct fec_rx_block *b = fec_rx_block_get(rx, seq / rx->code.n);
+
+	if (!b || len > rx->seg)
+		return true;
+	if (blk_has(b, slot))
+		return false;
+
+	memcpy(b->buf + slot * rx->seg, data, len);
+	b->have[slot >> 3] |= 1 << (slot & 7);
+	b->ndata++;
+	fec_rx_try(rx, b);
+	return true;
+}
+
+
+void fec_rx_parity(struct fec_rx *rx, unsigned long long block, unsigned int index,
+		unsigned int count, size_t tail_len, const unsigned char *data, size_t len)
+{
+	unsigned int slot = rx->code.n + index;
+	struct fec_rx_block *b;
+
+	if (index >= rx->code.k || count == 0 || count > rx->code.n ||
+			tail_len > rx->seg || len > rx->seg)
+		return;
+
+	rx->parity++;
+
+	b = fec_rx_block_get(rx, block);
+	if (!b || blk_has(b, slot))
+		return;
+
+	memcpy(b->buf + slot * rx->seg, data, len);
+	b->have[slot >> 3] |= 1 << (slot & 7);
+	b->nparity++;
+	b->count = count;
+	b->tail_len = tail_len;
+	fec_rx_try(rx, b);
+}
+
+
+/* account the blocks still in the window, total is the number of
+** data datagrams of the transfer (0 if unknown): the last block of
+** the file is short and its parity may have been lost */
+void fec_rx_finish(struct fec_rx *rx, unsigned long long total)
+{
+	unsigned int i;
+
+	for (i = 0; i < rx->window; i++) {
+		struct fec_rx_block *b = &rx->blocks[i];
+		unsigned long long first = b->block * rx->code.n;
+
+		if (b->used && total && first + b->count > total)
+			b->count = total > first ? total - first : 0;
+		fec_rx_retire(rx, b);
+	}
+}
+
+
+void fec_rx_free(struct fec_rx *rx)
+{
+	free(rx->mem);
+	free(rx->blocks);
+}
+
+/* vim:set ts=4 sw=4 sts=4 tw=78 ff=unix noet: */
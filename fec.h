@@ -0,0 +1,76 @@
+#ifndef NETSEND_FEC_H_INCLUDE_
+#define NETSEND_FEC_H_INCLUDE_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Forward error correction for sequenced datagrams (udp -F).
+** The data datagrams are grouped into blocks of n, every block
+** is followed by k parity datagrams. xor has one parity datagram
+** (the sum of all data), rs is a systematic Reed-Solomon code over
+** GF(2^8) with a Cauchy matrix: any n of the n + k datagrams of a
+** block rebuild the data. Short datagrams are zero padded to the
+** segment size, the last block of a file may hold less than n.
+*/
+
+enum fec_type { FEC_NONE, FEC_XOR, FEC_RS };
+
+#define	FEC_MAX_N 128
+#define	FEC_MAX_K 32
+
+struct fec_code {
+	enum fec_type type;
+	unsigned int n;
+	unsigned int k;
+};
+
+/* sender side: parity of the current block */
+struct fec_tx {
+	struct fec_code code;
+	size_t seg;
+	unsigned long long block;
+	unsigned int count;     /* < data datagrams added to the block */
+	size_t tail_len;        /* < length of the last data datagram */
+	unsigned char **parity; /* < k buffers of seg bytes */
+};
+
+/* receiver side: a window of blocks under reconstruction */
+typedef void (*fec_deliver_t)(void *ctx, unsigned long long seq,
+		const unsigned char *data, size_t len);
+
+struct fec_rx_block;
+
+struct fec_rx {
+	struct fec_code code;
+	size_t seg;
+	unsigned int window;
+	struct fec_rx_block *blocks;
+	unsigned char *mem;
+	fec_deliver_t deliver;
+	void *ctx;
+
+	unsigned long long parity;        /* < parity datagrams received */
+	unsigned long long recovered;     /* < data datagrams rebuilt */
+	unsigned long long unrecoverable; /* < blocks with too much loss */
+};
+
+const char *fec_type_str(enum fec_type);
+
+void fec_tx_init(struct fec_tx *, const struct fec_code *, size_t seg);
+void fec_tx_add(struct fec_tx *, const unsigned char *data, size_t len);
+void fec_tx_next(struct fec_tx *);
+void fec_tx_free(struct fec_tx *);
+
+void fec_rx_init(struct fec_rx *, const struct fec_code *, size_t seg,
+		fec_deliver_t, void *ctx);
+bool fec_rx_data(struct fec_rx *, unsigned long long seq,
+		const unsigned char *data, size_t len);
+void fec_rx_parity(struct fec_rx *, unsigned long long block, unsigned int index,
+		unsigned int count, size_t tail_len, const unsigned char *data, size_t len);
+void fec_rx_finish(struct fec_rx *, unsigned long long total);
+void fec_rx_free(struct fec_rx *);
+
+#endif /* NETSEND_FEC_H_INCLUDE_ */
+
+/* vim:set ts=4 sw=4 sts=4 tw=78 ff=unix noet: */
@@ -0,0 +1,214 @@
+/*
+** netsend - a high performance filetransfer and diagnostic tool
+** http://netsend.berlios.de
+**
+**
+** Copyright (C) 2006 - Hagen Paul Pfeifer <hagen@jauu.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Encode, erase and decode check of the forward error correction
+** (udp -F). Loopback transfers never lose a datagram, so the
+** decoder is exercised here: every code is run with every region
+** kernel the CPU supports, blocks lose up to k data datagrams and
+** the parity datagrams which were not needed, the last block of
+** the file is short. The static kernels are reached by including
+** fec.c. Exits non zero on a mismatch.
+*/
+
+#include "fec.c"
+
+#include <stdio.h>
+
+struct opts opts;
+struct net_stat net_stat;
+
+#define	TEST_SEG 1357 /* < no multiple of 16 or 32: the SIMD tails run too */
+
+struct test_out {
+	unsigned char *data;
+	size_t seg;
+};
+
+
+static void test_deliver(void *ctx, unsigned long long seq,
+		const unsigned char *data, size_t len)
+{
+	struct test_out *out = ctx;
+
+	memcpy(out->data + seq * out->seg, data, len);
+}
+
+
+/* deterministic pseudo random numbers, the runs are reproducible */
+static unsigned int test_rand(void)
+{
+	static unsigned int x = 0x2545f491;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+
+/* length of datagram seq of a file of len bytes */
+static size_t test_dlen(size_t len, unsigned long long seq)
+{
+	return min(len - (size_t) seq * TEST_SEG, (size_t) TEST_SEG);
+}
+
+
+/* Transmit a file of a bit more than 3.5 blocks. Block b loses
+** (b + k) % (k + 1) data datagrams - the first one k - and the
+** parity it doesn't need. Block lossy (~0: none) loses one data
+** datagram more than the parity can rebuild. Return the number
+** of failures.
+*/
+static int test_code(const char *kernel, const struct fec_code *code,
+		unsigned long long lossy)
+{
+	size_t len = TEST_SEG * (3 * code->n + code->n / 2 + 1) - 100;
+	unsigned long long total = (len + TEST_SEG - 1) / TEST_SEG, seq, block;
+	unsigned long long erased = 0;
+	unsigned char *in = xmalloc(len), *parity;
+	struct test_out out = { .data = xzalloc(len), .seg = TEST_SEG };
+	struct fec_tx tx;
+	struct fec_rx rx;
+	size_t i;
+	int failed = 0;
+
+	for (i = 0; i < len; i++)
+		in[i] = test_rand();
+
+	fec_tx_init(&tx, code, TEST_SEG);
+	fec_rx_init(&rx, code, TEST_SEG, test_deliver, &out);
+	parity = xmalloc(code->k * TEST_SEG);
+
+	for (block = 0; block * code->n < total; block++) {
+		unsigned long long first = block * code->n;
+		unsigned int count = min(total - first, (unsigned long long) code->n);
+		unsigned int e = (block + code->k) % (code->k + 1), j;
+		bool lost[FEC_MAX_N] = { false };
+		size_t plen;
+
+		if (block == lossy)
+			e = code->k + 1;
+		e = min(e, count);
+
+		/* encode, the parity is sent after the data */
+		for (j = 0; j < count; j++) {
+			seq = first + j;
+			fec_tx_add(&tx, in + seq * TEST_SEG, test_dlen(len, seq));
+		}
+		plen = tx.count == 1 ? tx.tail_len : tx.seg;
+		for (j = 0; j < code->k; j++)
+			memcpy(parity + j * TEST_SEG, tx.parity[j], plen);
+
+		/* erase e random data datagrams of the block */
+		for (j = 0; j < e; ) {
+			unsigned int victim = test_rand() % count;
+
+			if (!lost[victim]) {
+				lost[victim] = true;
+				j++;
+			}
+		}
+		erased += block == lossy ? 0 : e;
+
+		for (j = 0; j < count; j++) {
+			seq = first + j;
+			if (lost[j])
+				continue;
+			memcpy(out.data + seq * TEST_SEG, in + seq * TEST_SEG, test_dlen(len, seq));
+			fec_rx_data(&rx, seq, in + seq * TEST_SEG, test_dlen(len, seq));
+		}
+
+		/* only the last e parity datagrams arrive */
+		for (j = code->k - min(e, code->k); j < code->k; j++)
+			fec_rx_parity(&rx, block, j, tx.count, tx.tail_len,
+					parity + j * TEST_SEG, plen);
+
+		fec_tx_next(&tx);
+	}
+	fec_rx_finish(&rx, total);
+
+	if (lossy == ~0ULL && memcmp(in, out.data, len)) {
+		fprintf(stderr, "%s %s %u+%u: rebuilt data differs\n", kernel,
+				fec_type_str(code->type), code->n, code->k);
+		failed++;
+	}
+	if (rx.recovered != erased || rx.unrecoverable != (lossy != ~0ULL)) {
+		fprintf(stderr, "%s %s %u+%u: %llu of %llu datagrams rebuilt, "
+				"%llu unrecoverable blocks\n", kernel, fec_type_str(code->type),
+				code->n, code->k, rx.recovered, erased, rx.unrecoverable);
+		failed++;
+	}
+
+	fec_rx_free(&rx);
+	fec_tx_free(&tx);
+	free(parity);
+	free(out.data);
+	free(in);
+	return failed;
+}
+
+
+int
+main(void)
+{
+	static const struct fec_code codes[] = {
+		{ FEC_XOR, 8, 1 }, { FEC_RS, 8, 2 }, { FEC_RS, 16, 4 },
+		{ FEC_RS, 5, 3 }, { FEC_RS, FEC_MAX_N, FEC_MAX_K },
+	};
+	struct {
+		const char *name;
+		void (*fn)(uint8_t *, const uint8_t *, uint8_t, size_t);
+		bool supported;
+	} kernels[3] = {
+		{ "generic", region_mul_add_generic, true },
+	};
+	unsigned int i, k, nkernels = 1;
+	int failed = 0;
+
+	fec_init();
+#ifdef HAVE_X86_SIMD
+	kernels[nkernels].name = "ssse3";
+	kernels[nkernels].fn = region_mul_add_ssse3;
+	kernels[nkernels++].supported = __builtin_cpu_supports("ssse3");
+	kernels[nkernels].name = "avx2";
+	kernels[nkernels].fn = region_mul_add_avx2;
+	kernels[nkernels++].supported = __builtin_cpu_supports("avx2");
+#endif
+
+	for (k = 0; k < nkernels; k++) {
+		if (!kernels[k].supported) {
+			printf("%s: not supported by the cpu, skipped\n", kernels[k].name);
+			continue;
+		}
+		region_mul_add = kernels[k].fn;
+
+		for (i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+			failed += test_code(kernels[k].name, &codes[i], ~0ULL);
+			failed += test_code(kernels[k].name, &codes[i], 1);
+		}
+		printf("%s: %s\n", kernels[k].name, failed ? "failed" : "passed");
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* vim:set ts=4 sw=4 sts=4 tw=78 ff=unix noet: */
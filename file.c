@@ -20,11 +20,13 @@
 ** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
+#define _GNU_SOURCE /* O_DIRECT */
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
@@ -38,7 +40,7 @@ extern struct opts opts;
 int
 open_input_file(void)
 {
-	int fd, ret;
+	int fd, ret, flags;
 	struct stat stat_buf;
 
 	if (!strncmp(opts.infile, "-", 1))
@@ -49,11 +51,22 @@ open_input_file(void)
 	if (ret == -1)
 		err_sys_die(EXIT_FAILMISC, "Can't stat file %s", opts.infile);
 
+	flags = O_RDONLY;
 #ifdef O_NOATIME
-	fd = open(opts.infile, O_RDONLY|O_NOATIME);
-#else
-	fd = open(opts.infile, O_RDONLY);
+	flags |= O_NOATIME;
 #endif
+	/* bypass the page cache, e.g. for data which is never read again */
+	if ((opts.io_flags & IOF_DIRECT) && S_ISREG(stat_buf.st_mode))
+		flags |= O_DIRECT;
+
+	fd = open(opts.infile, flags);
+	if (fd == -1 && (flags & O_DIRECT) && errno == EINVAL) {
+		/* once is enough - stream threads open the file again */
+		err_msg("%s: file system doesn't support O_DIRECT, use the page cache",
+				opts.infile);
+		opts.io_flags &= ~IOF_DIRECT;
+		fd = open(opts.infile, flags & ~O_DIRECT);
+	}
 	if (fd == -1)
 		err_msg_die(EXIT_FAILMISC, "Can't open input file: %s", opts.infile);
 
@@ -64,7 +77,7 @@ open_input_file(void)
 int
 open_output_file(void)
 {
-	int fd = 0;
+	int fd = 0, flags = O_WRONLY;
 
 	if (!opts.outfile)
 		return STDOUT_FILENO;
@@ -72,16 +85,32 @@ open_output_file(void)
 	if (!strncmp(opts.outfile, "-", 1))
 		return STDOUT_FILENO;
 
+	/* receiving into a mapping (-u mmap) needs read access */
+	if (opts.io_call == IO_MMAP)
+		flags = O_RDWR;
+
 	umask(0);
 
-	fd = open(opts.outfile, O_WRONLY | O_CREAT | O_EXCL,
+	if (opts.io_flags & IOF_DIRECT) {
+		fd = open(opts.outfile, flags | O_CREAT | O_EXCL | O_DIRECT,
+				  S_IRUSR | S_IWUSR | S_IRGRP);
+		if (fd != -1)
+			return fd;
+		if (errno == EINVAL) {
+			msg(GENTLE, "file system doesn't support O_DIRECT, use the page cache");
+			opts.io_flags &= ~IOF_DIRECT;
+			unlink(opts.outfile);
+		}
+	}
+
+	fd = open(opts.outfile, flags | O_CREAT | O_EXCL,
 			  S_IRUSR | S_IWUSR | S_IRGRP);
 	if (fd == -1) {
 		struct stat s;
 		if (errno != EEXIST)
 			err_sys_die(EXIT_FAILOPT, "Can't create outputfile: %s", opts.outfile);
 
-		fd = open(opts.outfile, O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP);
+		fd = open(opts.outfile, flags, S_IRUSR | S_IWUSR | S_IRGRP);
 		if (fd == -1)
 			err_sys_die(EXIT_FAILOPT, "Can't open outputfile: %s", opts.outfile);
 
@@ -96,4 +125,100 @@ open_output_file(void)
 }
 
 
+/* Create the output file of one sender of the receive daemon. The
+** template expands %p (peer address), %P (peer port), %t (local time
+** of the connect), %n (connection number) and %%. The expanded name
+** ends up in path. An existing file is never overwritten, a failure
+** turns the sender away - not the daemon - so return -1.
+*/
+int
+open_conn_output_file(const char *template, const char *peer, const char *port,
+		unsigned long long n, char *path, size_t path_len)
+{
+	int fd;
+	size_t len = 0;
+	const char *t;
+	char stamp[32];
+	time_t now = time(NULL);
+
+	if (!strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now)))
+		stamp[0] = '\0';
+
+	/* every piece must fit, a truncated name could hit another file */
+	path[0] = '\0';
+	for (t = template; *t; t++) {
+		char lit[2] = { *t, '\0' }, num[24];
+		const char *piece = lit;
+		int ret;
+
+		if (*t == '%' && t[1]) {
+			switch (*++t) {
+			case 'p':
+				piece = peer;
+				break;
+			case 'P':
+				piece = port;
+				break;
+			case 't':
+				piece = stamp;
+				break;
+			case 'n':
+				snprintf(num, sizeof(num), "%llu", n);
+				piece = num;
+				break;
+			default: /* %% and unknown conversions */
+				lit[0] = *t;
+				break;
+			}
+		}
+
+		ret = snprintf(path + len, path_len - len, "%s", piece);
+		if (ret < 0 || (size_t) ret >= path_len - len) {
+			err_msg("output file name exceeds %zu byte: %s", path_len - 1, template);
+			return -1;
+		}
+		len += ret;
+	}
+
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (fd == -1)
+		err_sys("Can't create outputfile: %s", path);
+
+	return fd;
+}
+
+
+/* Reserve the blocks for len bytes at offset of a regular output
+** file up front, so the file system allocates them in one piece and
+** not one write at a time. extend sets the file size as well (the
+** mmap receiver needs it), else the size grows with the data. Return
+** the number of preallocated bytes.
+*/
+unsigned long long
+prealloc_output_file(int fd, unsigned long long offset, unsigned long long len,
+		bool extend)
+{
+	struct stat stat_buf;
+
+	xfstat(fd, &stat_buf, opts.outfile ? opts.outfile : "stdout");
+	if (!S_ISREG(stat_buf.st_mode) || len == 0)
+		return 0;
+
+#ifdef HAVE_FALLOCATE
+	if (fallocate(fd, extend ? 0 : FALLOC_FL_KEEP_SIZE, offset, len) == 0) {
+		msg(LOUDISH, "preallocated %llu byte at offset %llu", len, offset);
+		return len;
+	}
+	msg(LOUDISH, "can't preallocate the output file: %s", strerror(errno));
+#endif
+
+	/* ftruncate() may shrink, fallocate() does not */
+	if (extend && (unsigned long long) stat_buf.st_size < offset + len &&
+			ftruncate(fd, offset + len))
+		err_sys_die(EXIT_FAILMISC, "Can't extend output file to %llu byte", offset + len);
+
+	return 0;
+}
+
+
 /* vim:set ts=4 sw=4 tw=78 noet: */
@@ -76,26 +76,39 @@ static const char const help_str[][4096] = {
     "Usage: netsend [OPTIONS] PROTOCOL MODE { COMMAND | HELP } [filename] [hostname]\n"
 	" OPTIONS      := { -T FORMAT | -6 | -4 | -n | -d | -r RTTPROBE | -P SCHED-POLICY | -N level\n"
 	"                   -m MEM-ADVISORY | -V[version] | -v[erbose] LEVEL | -h[elp] | -a[ll-options] }\n"
-	"                   -p PORT -s SETSOCKOPT_OPTNAME _OPTVAL -b READWRITE_BUFSIZE -u SEND-ROUTINE\n"
-#if 0
-	"                   -P <processing-threads>\n" /* not implemented */
-#endif
+	"                   -p PORT -s SETSOCKOPT_OPTNAME _OPTVAL -b { READWRITE_BUFSIZE | auto } -u SEND-ROUTINE\n"
+	"                   -P <parallel-streams> --rate RATE --sync WINDOW --busy-poll BUSY-POLL\n"
 	" PROTOCOL     := { tcp | udp | udplite | dccp | sctp | tipc | unix }\n"
 	" COMMAND      := { UDP-OPTIONS | UDPL-OPTIONS | SCTP-OPTIONS | DCCP-OPTIONS | TIPC-OPTIONS | TCP-OPTIONS }\n"
 	" MODE         := { receive | transmit }\n"
 	" FORMAT       := { human | machine }\n"
-	" SEND-ROUTINE := { mmap | sendfile | splice | rw }\n"
+	" SEND-ROUTINE := { mmap | sendfile | splice | rw | uring }[:MODIFIER[,MODIFIER]]\n"
 	" RTTPROBE     := { 10n,10d,10m,10f }\n"
+	" RATE         := N[.N][k|m|g|t] bit/s, e.g. 2.5g or 800m\n"
+	" WINDOW       := N[k|m|g] Byte, e.g. 8m\n"
+	" BUSY-POLL    := USEC[:budget=N,spin], e.g. 50:spin\n"
 	" MEM-ADVISORY := { normal | sequential | random | willneed | dontneed | noreuse }\n"
 	" SCHED-POLICY := { sched_rr | sched_fifo | sched_batch | sched_other } priority\n"
 	" LEVEL        := { quitscent | gentle | loudish | stressful }",
 #define	HELP_STR_TCP 1
 	" CC-ALGORITHM := -s TCP_CONGESTION { bic | cubic | highspeed | htcp | hybla | illinois | scalable | vegas | westwood | reno | YeAH }\n"
-	" TCP_MD5SIG := -C [ peer-IP-Address ] (receive mode only)",
+	" TCP_MD5SIG := -C [ peer-IP-Address ] (receive mode only)\n"
+	" DAEMON := --daemon [ file-template ] (receive mode only, rw)\n"
+	"     serve any number of senders until SIGINT/SIGTERM, one file each:\n"
+	"     %p peer address, %P peer port, %t time, %n connection number\n"
+	"     (default " DEFAULT_DAEMON_TEMPLATE ")",
 #define	HELP_STR_UDP 2
-	" UDP-OPTIONS  := [ FIXME ]",
+	" UDP-OPTIONS  := [ -M <batch> ] [ -G ] [ -S ] [ -R <receivers> ] [ -F <fec> ]\n"
+	" -M: send respective receive batch datagrams per sendmmsg/recvmmsg call (io call rw)\n"
+	" -G: transmit with UDP GSO, segment size is the path MTU payload or -b\n"
+	"     receive with UDP GRO and count the coalesced datagrams\n"
+	" -S: transmit sequence numbered datagrams, the receiver reports loss,\n"
+	"     duplicates, reordering and jitter\n"
+	" -R: reliable multicast, repair NAKed datagrams until all receivers confirmed\n"
+	" -F: forward error correction, xor:N (one parity per N datagrams) or\n"
+	"     rs:N,K (K Reed-Solomon parity datagrams per N)",
 #define	HELP_STR_UDPLITE 3
-	" UDPL-OPTIONS := [ -C <checksum_coverage> ]",
+	" UDPL-OPTIONS := [ -C <checksum_coverage> ] [ -M <batch> ] [ -S ] [ -F <fec> ]",
 #define	HELP_STR_SCTP 4
 	" SCTP_DISABLE_FRAGMENTS ",
 #define	HELP_STR_DCCP 5
@@ -121,8 +134,11 @@ static const char const help_str[][4096] = {
 #define	HELP_STR_MEM_ADVICE 10
 	" MEM-ADVISORY := { normal | sequential | random | willneed | dontneed | noreuse }",
 #define	HELP_STR_IO_ADVICE 11
-	" IO-CALL := { mmap | sendfile | splice | rw }"
-#define	HELP_STR_READ_DELAY 11
+	" IO-CALL := { mmap | sendfile | splice | rw | uring }[:MODIFIER[,MODIFIER]]\n"
+	" MODIFIER := { depth=N | sqpoll | zc | pipeline | pipe=SIZE | window=SIZE | direct }\n"
+	"             depth: uring, rw - sqpoll: uring - zc: uring, rw, mmap - pipeline: rw\n"
+	"             pipe: splice - window: mmap - direct: rw, uring - SIZE := N[k|m|g]",
+#define	HELP_STR_READ_DELAY 12
 	" READ_DELAY := { delay_time | initial_delay_time:delay_time }"
 };
 
@@ -406,6 +422,16 @@ static void parse_tcp_opt(int ac, char *av[], struct opts *optsp)
 	optsp->socktype = SOCK_STREAM;
 
 	while (av[0] && av[0][0] == '-') {
+		/* receive --daemon [ file-template ] */
+		if (!strcmp(av[0], "--daemon")) {
+			if (optsp->workmode != MODE_RECEIVE)
+				die_usage("--daemon applies to the receiver only", HELP_STR_TCP);
+			optsp->rx_daemon = true;
+			ac--;
+			av++;
+			continue;
+		}
+
 		if (av[0][1] == 'C')
 			optsp->tcp_use_md5sig = true;
 
@@ -427,6 +453,15 @@ static void parse_tcp_opt(int ac, char *av[], struct opts *optsp)
 	 * important options: the file- and hostname
 	 */
 	parse_filename(ac, av, optsp, HELP_STR_GLOBAL);
+
+	/* the daemon creates one file per sender, never stdout */
+	if (optsp->rx_daemon) {
+		if (!optsp->outfile)
+			optsp->outfile = DEFAULT_DAEMON_TEMPLATE;
+		if (!strcmp(optsp->outfile, "-"))
+			die_usage("--daemon needs a file template, not stdout", HELP_STR_TCP);
+		msg(GENTLE, "receive daemon, output files %s", optsp->outfile);
+	}
 }
 
 static void dump_tcp_opt(struct opts *optsp)
@@ -588,6 +623,112 @@ static void dump_dccp_opt(struct opts *optsp __attribute__((unused)))
 }
 
 
+/* xor:N - one parity datagram per N data datagrams,
+** rs:N,K - K Reed-Solomon parity datagrams per N */
+static int parse_fec_code(const char *str, struct fec_code *code)
+{
+	unsigned int n, k = 1;
+	char c;
+
+	if (sscanf(str, "xor:%u%c", &n, &c) == 1) {
+		code->type = FEC_XOR;
+	} else if (sscanf(str, "rs:%u,%u%c", &n, &k, &c) == 2) {
+		code->type = FEC_RS;
+	} else {
+		return -1;
+	}
+
+	if (n < 1 || n > FEC_MAX_N || k < 1 || k > FEC_MAX_K) {
+		fprintf(stderr, "fec needs 1 - %d data and 1 - %d parity datagrams\n",
+				FEC_MAX_N, FEC_MAX_K);
+		return -1;
+	}
+
+	code->n = n;
+	code->k = k;
+	return 0;
+}
+
+
+/* options shared by udp and udplite, return the number
+ * of consumed arguments or 0 if av[0] is no such option */
+static int parse_dgram_opt(char *av[], struct opts *optsp, int helpt)
+{
+	int batch, receivers;
+
+	if (av[0][1] == 'M') {
+		if (!av[1] || !scan_int(av[1], &batch))
+			die_usage("option M requires a numeric argument", helpt);
+
+		if (batch <= 0 || batch > MAX_MMSG_BATCH) {
+			fprintf(stderr, "batch must be between 1 and %d\n", MAX_MMSG_BATCH);
+			die_usage(NULL, helpt);
+		}
+		if (optsp->io_call != IO_RW ||
+			(optsp->io_flags & (IOF_PIPELINE | IOF_ZEROCOPY)))
+			die_usage("option M requires the plain rw io call", helpt);
+
+		optsp->mmsg_batch = batch;
+		return 2;
+	}
+
+	/* -G: transmit with UDP GSO */
+	if (av[0][1] == 'G' && optsp->workmode == MODE_TRANSMIT) {
+		if (optsp->protocol != IPPROTO_UDP)
+			die_usage("option G requires udp", helpt);
+		if (optsp->io_call != IO_RW || optsp->buffer_auto ||
+			(optsp->io_flags & IOF_DIRECT))
+			die_usage("option G requires the rw io call without -b auto and direct", helpt);
+
+		if (optsp->udp_seq)
+			die_usage("option G excludes S, R and F", helpt);
+
+		optsp->udp_gso = true;
+		return 1;
+	}
+
+	/* -S: sequence numbered datagrams, the receiver detects it via ns_hdr.
+	 * -R: reliable multicast and -F: forward error correction on top of it */
+	if ((av[0][1] == 'S' || av[0][1] == 'R' || av[0][1] == 'F') &&
+			optsp->workmode == MODE_TRANSMIT) {
+		if (optsp->io_call != IO_RW || optsp->buffer_auto ||
+			(optsp->io_flags & (IOF_PIPELINE | IOF_ZEROCOPY | IOF_DIRECT)))
+			die_usage("options S, R and F require the plain rw io call without -b auto", helpt);
+		if (optsp->udp_gso)
+			die_usage("option G excludes S, R and F", helpt);
+
+		optsp->udp_seq = true;
+		if (av[0][1] == 'S')
+			return 1;
+
+		if (av[0][1] == 'F') {
+			if (!av[1] || parse_fec_code(av[1], &optsp->fec))
+				die_usage("option F requires xor:N or rs:N,K", helpt);
+			return 2;
+		}
+
+		if (optsp->protocol != IPPROTO_UDP)
+			die_usage("option R requires udp", helpt);
+		if (!av[1] || !scan_int(av[1], &receivers) || receivers <= 0)
+			die_usage("option R requires the number of receivers", helpt);
+
+		optsp->nak_receivers = receivers;
+		return 2;
+	}
+
+	/* -G: receive with UDP GRO */
+	if (av[0][1] == 'G' && optsp->workmode == MODE_RECEIVE) {
+		if (optsp->protocol != IPPROTO_UDP)
+			die_usage("option G requires udp", helpt);
+
+		optsp->udp_gro = true;
+		return 1;
+	}
+
+	return 0;
+}
+
+
 static void parse_udplite_opt(int ac, char *av[],struct opts *optsp)
 {
 	/* memorize protocol */
@@ -604,6 +745,7 @@ static void parse_udplite_opt(int ac, char *av[],struct opts *optsp)
 	 */
 	do {
 		char *endptr;
+		int consumed;
 
 		/* break if we reach the end of the OPTIONS or we see
 		 * the special option '-' -> this indicate the special
@@ -615,6 +757,12 @@ static void parse_udplite_opt(int ac, char *av[],struct opts *optsp)
 		if (!av[0][1] || !isalnum(av[0][1]))
 			die_usage(NULL, HELP_STR_TCP);
 
+		if ((consumed = parse_dgram_opt(av, optsp, HELP_STR_UDPLITE))) {
+			ac -= consumed;
+			av += consumed;
+			continue;
+		}
+
 		if (av[0][1] == 'C') {
 			if (!av[1])
 				die_usage("UDPLite option C requires an argument",
@@ -658,7 +806,27 @@ static void parse_udp_opt(int ac, char *av[],struct opts *optsp)
 	optsp->protocol = IPPROTO_UDP;
 	optsp->socktype = SOCK_DGRAM;
 
-	parse_filename(ac, av, optsp, HELP_STR_UDPLITE);
+	for (;;) {
+		int consumed;
+
+		/* '-' alone is the special output file "stdout" */
+		if (!av[0] || av[0][0] != '-' || !av[0][1])
+			break;
+
+		if (!isalnum(av[0][1]))
+			die_usage(NULL, HELP_STR_UDP);
+
+		if ((consumed = parse_dgram_opt(av, optsp, HELP_STR_UDP))) {
+			ac -= consumed;
+			av += consumed;
+			continue;
+		}
+
+		ac--;
+		av++;
+	}
+
+	parse_filename(ac, av, optsp, HELP_STR_UDP);
 }
 
 
@@ -731,9 +899,10 @@ static int parse_rtt_string(const char *rtt_cmd, struct opts *optsp __attribute_
 		switch (*what) {
 		case 'n':
 			optsp->rtt_probe_opt.iterations = value;
-			if (value <= 0 || value > 100) {
+			/* enough probes for the p99 of the latency distribution */
+			if (value <= 0 || value > 10000) {
 				fprintf(stderr, "You want %ld rtt probe iterations - that's not sensible! "
-						"Valid range is between 1 and 100 probe iterations\n", value);
+						"Valid range is between 1 and 10000 probe iterations\n", value);
 				return FAILURE;
 			}
 			break;
@@ -776,6 +945,219 @@ static int parse_rtt_string(const char *rtt_cmd, struct opts *optsp __attribute_
 	return SUCCESS;
 }
 
+/* io call modifier, e.g. -u uring:depth=64,sqpoll,zc
+ * io_mask contains all io calls (1 << IO_*) which accept
+ * the modifier */
+enum io_mod_type { IOM_FLAG, IOM_DEPTH, IOM_PIPE_SIZE, IOM_WINDOW };
+
+static const struct io_modifier {
+	const char *name;
+	enum io_mod_type type;
+	unsigned long flag;
+	unsigned int io_mask;
+} io_modifier_map[] = {
+	{ "depth",    IOM_DEPTH, 0,            1 << IO_URING | 1 << IO_RW },
+	{ "sqpoll",   IOM_FLAG,  IOF_SQPOLL,   1 << IO_URING },
+	{ "zc",       IOM_FLAG,  IOF_ZEROCOPY, 1 << IO_URING | 1 << IO_RW | 1 << IO_MMAP },
+	{ "pipeline", IOM_FLAG,  IOF_PIPELINE, 1 << IO_RW },
+	{ "pipe",     IOM_PIPE_SIZE, 0,        1 << IO_SPLICE },
+	{ "window",   IOM_WINDOW, 0,           1 << IO_MMAP },
+	{ "direct",   IOM_FLAG,  IOF_DIRECT,   1 << IO_RW | 1 << IO_URING },
+	{ "dontcache", IOM_FLAG, IOF_DONTCACHE, 1 << IO_RW },
+};
+
+/* parse a size with an optional binary unit suffix (k, m, g),
+ * return -1 for malformed strings */
+static long long scan_size(const char *str)
+{
+	char *endptr;
+	long long num;
+
+	errno = 0;
+	num = strtoll(str, &endptr, 10);
+	if (errno || endptr == str || num < 0)
+		return -1;
+
+	switch (tolower(*endptr)) {
+	case 'g': num <<= 10; /* fall through */
+	case 'm': num <<= 10; /* fall through */
+	case 'k': num <<= 10; endptr++; break;
+	case '\0': break;
+	default: return -1;
+	}
+
+	return *endptr ? -1 : num;
+}
+
+/* parse USEC[:budget=N,spin] of --busy-poll */
+static int parse_busy_poll(const char *str, struct opts *optsp)
+{
+	char *endptr;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(str, &endptr, 10);
+	if (errno || endptr == str || val == 0 || val > INT_MAX)
+		return FAILURE;
+	optsp->busy_poll_usec = val;
+
+	if (*endptr == '\0')
+		return SUCCESS;
+	if (*endptr != ':')
+		return FAILURE;
+
+	do {
+		str = endptr + 1;
+		if (!strncmp(str, "spin", 4)) {
+			optsp->busy_poll_spin = true;
+			endptr = (char *) str + 4;
+		} else if (!strncmp(str, "budget=", 7)) {
+			val = strtoul(str + 7, &endptr, 10);
+			if (endptr == str + 7 || val == 0 || val > UINT16_MAX)
+				return FAILURE;
+			optsp->busy_poll_budget = val;
+		} else {
+			return FAILURE;
+		}
+	} while (*endptr == ',');
+
+	return *endptr ? FAILURE : SUCCESS;
+}
+
+/* parse a rate in bit/s with an optional SI suffix (k, m, g, t),
+ * e.g. 2.5g. Return 0 for malformed or zero rates */
+static unsigned long long scan_rate(const char *str)
+{
+	char *endptr;
+	double num;
+
+	errno = 0;
+	num = strtod(str, &endptr);
+	if (errno || endptr == str || num <= 0)
+		return 0;
+
+	switch (tolower(*endptr)) {
+	case 't': num *= 1000; /* fall through */
+	case 'g': num *= 1000; /* fall through */
+	case 'm': num *= 1000; /* fall through */
+	case 'k': num *= 1000; endptr++; break;
+	case '\0': break;
+	default: return 0;
+	}
+
+	return *endptr ? 0 : (unsigned long long) num;
+}
+
+static int parse_io_modifier(char *tok, struct opts *optsp)
+{
+	unsigned int i;
+	char *value, *endptr;
+	long depth;
+	long long size;
+
+	value = strchr(tok, '=');
+	if (value)
+		*value++ = '\0';
+
+	for (i = 0; i < ARRAY_SIZE(io_modifier_map); i++) {
+		if (!strcasecmp(tok, io_modifier_map[i].name))
+			break;
+	}
+	if (i == ARRAY_SIZE(io_modifier_map)) {
+		fprintf(stderr, "io call modifier %s not supported\n", tok);
+		return FAILURE;
+	}
+
+	if (!(io_modifier_map[i].io_mask & (1 << optsp->io_call))) {
+		fprintf(stderr, "io call modifier %s not supported by this io call\n", tok);
+		return FAILURE;
+	}
+
+	if (io_modifier_map[i].type == IOM_FLAG && value) {
+		fprintf(stderr, "io call modifier %s takes no value\n", tok);
+		return FAILURE;
+	}
+	if (io_modifier_map[i].type != IOM_FLAG && !value) {
+		fprintf(stderr, "io call modifier %s requires a value\n", tok);
+		return FAILURE;
+	}
+
+	switch (io_modifier_map[i].type) {
+	case IOM_FLAG:
+		optsp->io_flags |= io_modifier_map[i].flag;
+		break;
+	case IOM_DEPTH:
+		depth = strtol(value, &endptr, 10);
+		if (*endptr || depth <= 0 || depth > 4096) {
+			fprintf(stderr, "%s is not a sensible queue depth (1 - 4096)\n", value);
+			return FAILURE;
+		}
+		optsp->io_depth = depth;
+		break;
+	case IOM_PIPE_SIZE:
+		size = scan_size(value);
+		if (size < 4096 || size > INT_MAX) {
+			fprintf(stderr, "%s is not a sensible pipe size\n", value);
+			return FAILURE;
+		}
+		optsp->pipe_size = size;
+		break;
+	case IOM_WINDOW:
+		size = scan_size(value);
+		if (size < 4096) {
+			fprintf(stderr, "%s is not a sensible mmap window\n", value);
+			return FAILURE;
+		}
+		optsp->mmap_window = size;
+		break;
+	default:
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+static int parse_io_call(const char *io_cmd, struct opts *optsp)
+{
+	int i, ret = SUCCESS;
+	char *str, *mods, *tok, *saveptr;
+
+	str = xmalloc(strlen(io_cmd) + 1);
+	strcpy(str, io_cmd);
+
+	mods = strchr(str, ':');
+	if (mods)
+		*mods++ = '\0';
+
+	for (i = 0; i <= IO_MAX; i++ ) {
+		if (!strcasecmp(str, io_call_map[i].conf_string)) {
+			optsp->io_call = io_call_map[i].conf_code;
+			break;
+		}
+	}
+
+	if (i > IO_MAX) {
+		ret = FAILURE;
+		goto out;
+	}
+
+	if (!mods)
+		goto out;
+
+	for (tok = strtok_r(mods, ",", &saveptr); tok;
+		 tok = strtok_r(NULL, ",", &saveptr)) {
+		if ((ret = parse_io_modifier(tok, optsp)) != SUCCESS)
+			goto out;
+	}
+
+	if ((optsp->io_flags & IOF_PIPELINE) && (optsp->io_flags & IOF_ZEROCOPY)) {
+		fprintf(stderr, "io call modifier pipeline and zc can't be combined\n");
+		ret = FAILURE;
+	}
+ out:
+	free(str);
+	return ret;
+}
+
 static void dump_opts(struct opts *optsp __attribute__((unused)))
 {
 
@@ -818,6 +1200,8 @@ parse_opts(int ac, char *av[], struct opts *optsp)
 	 * thread will do the whole work */
 	optsp->threads = 1;
 
+	optsp->io_depth = DEFAULT_IO_DEPTH;
+
 	/* if opts->nice is INT_MAX, the nice level option wasn't specified on the command line */
 	optsp->nice = INT_MAX;
 
@@ -853,6 +1237,51 @@ parse_opts(int ac, char *av[], struct opts *optsp)
 		if (!av[FIRST_ARG_INDEX] || av[FIRST_ARG_INDEX][0] != '-')
 			break;
 
+		/* --rate RATE */
+		if (!strcmp(av[FIRST_ARG_INDEX], "--rate")) {
+			if (!av[2])
+				die_usage(NULL, HELP_STR_GLOBAL);
+
+			optsp->rate = scan_rate(av[2]);
+			if (optsp->rate == 0)
+				err_msg_die(EXIT_FAILOPT, "--rate: %s is not a rate (e.g. 800m or 2.5g)", av[2]);
+
+			av += 2; ac -= 2;
+			continue;
+		}
+
+		/* --busy-poll USEC[:budget=N,spin] */
+		if (!strcmp(av[FIRST_ARG_INDEX], "--busy-poll")) {
+			if (!av[2])
+				die_usage(NULL, HELP_STR_GLOBAL);
+
+			if (parse_busy_poll(av[2], optsp) != SUCCESS)
+				err_msg_die(EXIT_FAILOPT, "--busy-poll: %s is not USEC[:budget=N,spin] "
+						"(e.g. 50:spin)", av[2]);
+
+			av += 2; ac -= 2;
+			continue;
+		}
+
+		/* --sync WINDOW */
+		if (!strcmp(av[FIRST_ARG_INDEX], "--sync")) {
+			long long window;
+
+			if (!av[2])
+				die_usage(NULL, HELP_STR_GLOBAL);
+
+			window = scan_size(av[2]);
+			if (window < DIRECT_IO_ALIGN || window % DIRECT_IO_ALIGN)
+				err_msg_die(EXIT_FAILOPT, "--sync: %s is not a multiple of 4k (e.g. 8m)", av[2]);
+#ifndef HAVE_SYNC_FILE_RANGE
+			err_msg_die(EXIT_FAILOPT, "--sync: sync_file_range support not compiled in");
+#endif
+			optsp->sync_window = window;
+
+			av += 2; ac -= 2;
+			continue;
+		}
+
 		if (!av[FIRST_ARG_INDEX][1] || !isalnum(av[FIRST_ARG_INDEX][1]))
 			die_usage(NULL, HELP_STR_GLOBAL);
 
@@ -912,8 +1341,10 @@ parse_opts(int ac, char *av[], struct opts *optsp)
 			if (!av[2])
 				die_usage(NULL, HELP_STR_GLOBAL);
 
-			if (!scan_int(av[2], &optsp->buffer_size))
-				err_msg_die(EXIT_FAILOPT, "-b: writebuffersize must be a number");
+			if (!strcasecmp(av[2], "auto"))
+				optsp->buffer_auto = true;
+			else if (!scan_int(av[2], &optsp->buffer_size))
+				err_msg_die(EXIT_FAILOPT, "-b: writebuffersize must be a number or auto");
 
 			av += 2; ac -= 2;
 			continue;
@@ -945,14 +1376,7 @@ parse_opts(int ac, char *av[], struct opts *optsp)
 			if (!av[FIRST_ARG_INDEX + 1])
 				die_usage(NULL, HELP_STR_GLOBAL);
 
-			for (i = 0; i <= IO_MAX; i++ ) {
-				if (!strcasecmp(&av[FIRST_ARG_INDEX + 1][0], io_call_map[i].conf_string)) {
-					optsp->io_call = io_call_map[i].conf_code;
-					break;
-				}
-			}
-
-			if (i > IO_MAX) /* option error */
+			if (parse_io_call(av[FIRST_ARG_INDEX + 1], optsp) != SUCCESS)
 				die_usage(NULL, HELP_STR_IO_ADVICE);
 
 			av += 2; ac -= 2;
@@ -993,8 +1417,9 @@ parse_opts(int ac, char *av[], struct opts *optsp)
 				exit(EXIT_FAILOPT);
 			}
 
-			if (optsp->threads <= 0) {
-				die_usage("Number of threads must be greater then 0", HELP_STR_GLOBAL);
+			if (optsp->threads <= 0 || optsp->threads > MAX_STREAMS) {
+				fprintf(stderr, "Number of streams must be between 1 and %d\n", MAX_STREAMS);
+				die_usage(NULL, HELP_STR_GLOBAL);
 			}
 
 			av += 2; ac -= 2;
@@ -1188,6 +1613,54 @@ parse_opts(int ac, char *av[], struct opts *optsp)
 			die_usage("MODE isn't permitted:", HELP_STR_GLOBAL);
 		}
 		protocol_map[i].parse_proto(ac - 3, av + 3, optsp);
+
+		/* splice, io_uring, mmap and the pipeline replace the plain read
+		 * loop of the receiver */
+		if (optsp->workmode == MODE_RECEIVE &&
+			(optsp->io_call != IO_RW || (optsp->io_flags & IOF_PIPELINE)) &&
+			(optsp->mmsg_batch || optsp->udp_gro))
+			die_usage("splice, io_uring, mmap and pipeline receive exclude -M and -G",
+					HELP_STR_GLOBAL);
+
+		/* the receiver writes uncached from its own aligned buffers */
+		if (optsp->workmode == MODE_RECEIVE &&
+			(optsp->io_flags & (IOF_DIRECT | IOF_DONTCACHE)) &&
+			(optsp->io_call != IO_RW || (optsp->io_flags & IOF_PIPELINE) ||
+			 optsp->mmsg_batch || optsp->udp_gro))
+			die_usage("direct and dontcache receive need rw without pipeline, -M and -G",
+					HELP_STR_GLOBAL);
+
+		if (optsp->workmode != MODE_RECEIVE && (optsp->io_flags & IOF_DONTCACHE))
+			die_usage("dontcache applies to the receiver only", HELP_STR_GLOBAL);
+
+		/* zero copy receive maps the payload from a TCP socket */
+		if (optsp->workmode == MODE_RECEIVE && (optsp->io_flags & IOF_ZEROCOPY)) {
+#ifndef HAVE_TCP_ZEROCOPY_RECEIVE
+			err_msg_die(EXIT_FAILOPT, "TCP_ZEROCOPY_RECEIVE support not compiled in");
+#endif
+			if (optsp->ns_proto != NS_PROTO_TCP || optsp->io_call != IO_RW ||
+				(optsp->io_flags & (IOF_DIRECT | IOF_DONTCACHE)))
+				die_usage("zc receive requires tcp and rw without direct and dontcache",
+						HELP_STR_GLOBAL);
+		}
+
+		/* the io_uring and mmap receivers write back on their own */
+		if (optsp->sync_window && (optsp->workmode != MODE_RECEIVE ||
+			optsp->io_call == IO_URING || optsp->io_call == IO_MMAP))
+			die_usage("--sync applies to the rw and splice receivers only",
+					HELP_STR_GLOBAL);
+
+		/* the daemon multiplexes the senders in one plain read loop */
+		if (optsp->rx_daemon && (optsp->io_call != IO_RW || optsp->io_flags ||
+			optsp->delay_read_initial || optsp->delay_read))
+			die_usage("--daemon receives with rw only, without modifiers and delays",
+					HELP_STR_TCP);
+
+		/* parallel streams need one connection per stream */
+		if (optsp->threads > 1 && optsp->ns_proto != NS_PROTO_TCP &&
+			optsp->ns_proto != NS_PROTO_SCTP && optsp->ns_proto != NS_PROTO_DCCP)
+			die_usage("parallel streams (-P) require tcp, sctp or dccp", HELP_STR_GLOBAL);
+
 		if (dump_defaults) {
 			dump_opts(optsp);
 			protocol_map[i].dump_proto(optsp);
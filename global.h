@@ -22,15 +22,18 @@
 
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <netdb.h>
+#include <netinet/in.h>
 
 #include <sys/time.h>
 #include <sys/resource.h>
 
 #include "config.h"
 #include "error.h"
+#include "fec.h"
 #ifdef HAVE_RDTSCLL
 # include <linux/timex.h>
 
@@ -84,6 +87,14 @@
 # define SCTP_DISABLE_FRAGMENTS	8
 #endif
 
+#ifndef SO_ZEROCOPY
+# define SO_ZEROCOPY 60
+#endif
+
+#ifndef MSG_ZEROCOPY
+# define MSG_ZEROCOPY 0x4000000
+#endif
+
 /* Forces a function to be always inlined
 ** 'must inline' - so that they get inlined even
 ** if optimizing for size
@@ -134,7 +145,7 @@
 #define	VL_STRESSFUL(x)  (x >= 3)
 
 #define	PROGRAMNAME   "netsend"
-#define	VERSIONSTRING "002"
+#define	VERSIONSTRING "003"
 
 /* Default values */
 #define	DEFAULT_PORT    "5001"
@@ -142,6 +153,12 @@
 #define	BACKLOG         1
 #define	DEFAULT_BUFSIZE (8 * 1024)
 
+/* upper limit for parallel streams (-P) */
+#define	MAX_STREAMS     128
+
+/* upper limit for batched datagram calls (-M), the kernel limit UIO_MAXIOV */
+#define	MAX_MMSG_BATCH  1024
+
 enum sockopt_val_types {
 	SVT_BOOL = 0,
 	SVT_INT,
@@ -186,9 +203,26 @@ enum io_call {
 	IO_RW,/* 0=default xmit method */
 	IO_SENDFILE,
 	IO_MMAP,
-	IO_SPLICE
+	IO_SPLICE,
+	IO_URING
 };
-#define	IO_MAX IO_SPLICE
+#define	IO_MAX IO_URING
+
+/* io call modifier flags (-u ENGINE:modifier,...) */
+#define	IOF_SQPOLL      (1 << 0) /* io_uring kernel side submission polling */
+#define	IOF_ZEROCOPY    (1 << 1) /* zero copy send */
+#define	IOF_PIPELINE    (1 << 2) /* rw: separate reader thread */
+#define	IOF_DIRECT      (1 << 3) /* input (receiver: output) file with O_DIRECT */
+#define	IOF_DONTCACHE   (1 << 4) /* receiver: write with RWF_DONTCACHE */
+
+#define	DEFAULT_IO_DEPTH 32
+#define	DEFAULT_MMAP_WINDOW (64 * 1024 * 1024)
+#define	DEFAULT_ZC_RX_REGION (2 * 1024 * 1024) /* receiver -u rw:zc */
+#define	DEFAULT_DAEMON_TEMPLATE "netsend-%p-%t-%n" /* receive --daemon */
+
+/* buffer, length and offset alignment for O_DIRECT */
+#define	DIRECT_IO_ALIGN 4096
+#define	DIRECT_ALIGN_UP(x) (((x) + DIRECT_IO_ALIGN - 1) & ~((typeof(x)) DIRECT_IO_ALIGN - 1))
 
 /* Centralize our statistic data */
 
@@ -201,11 +235,21 @@ struct use_stat {
 };
 
 
+/* latency distribution of the rtt probes (-r) in microseconds */
+struct latency_dist {
+	unsigned int samples;
+	double min, p50, p90, p99, max;
+};
+
 struct net_stat {
 	struct rtt_probe {
 		double usec;
 		double variance;
 	} rtt_probe;
+
+	/* rtt probes without [0] and with [1] busy polling (--busy-poll),
+	 * [0] only without --busy-poll */
+	struct latency_dist latency[2];
 	struct  {
 		/* tcp attributes */
 		uint16_t mss;
@@ -219,6 +263,123 @@ struct net_stat {
 	unsigned int total_tx_calls;
 	unsigned long long total_tx_bytes;
 
+	/* io_uring: submitted requests, tx_calls are the io_uring_enter() calls */
+	unsigned long long total_tx_sqes;
+
+	/* io_uring receive: submitted requests (rx_calls are the
+	 * io_uring_enter() calls), recv completions and how often the
+	 * writes lagged behind and the buffer ring ran empty */
+	unsigned long long total_rx_sqes;
+	unsigned long long uring_recvs;
+	unsigned long long uring_nobufs;
+
+	/* receiver: bytes reserved via fallocate() and the windows of
+	 * the output file received into (-u mmap) */
+	unsigned long long prealloc;
+	unsigned long long mmap_windows;
+
+	/* receiver: nanoseconds spent in file writes and in the final fsync() */
+	unsigned long long write_ns;
+	unsigned long long sync_ns;
+
+	/* receiver --sync: windows written back behind the receive cursor,
+	 * nanoseconds spent in sync_file_range() and when the data was
+	 * durable (after the final fsync) */
+	unsigned long long sync_windows;
+	unsigned long long writeback_ns;
+	struct timeval durable;
+
+	/* TCP zero copy receive: bytes mapped from the socket and bytes
+	 * the kernel couldn't map and which were copied with read() */
+	unsigned long long zc_rx_mapped;
+	unsigned long long zc_rx_copied;
+
+	/* zero copy sends completed by the kernel - with or without a copy */
+	unsigned long long total_tx_zc;
+	unsigned long long total_tx_zc_copied;
+
+	/* rw pipeline: reader waits for a free buffer (network bound)
+	 * respective sender waits for data (disk bound). The receiver
+	 * swaps the roles: the socket reader waits for a free buffer
+	 * (storage bound), the file writer for data (network bound) */
+	unsigned long long ring_full_stalls;
+	unsigned long long ring_empty_stalls;
+
+	/* splice: size of the pipe and splice calls in both directions */
+	unsigned int pipe_size;
+	unsigned long long splice_calls;
+
+	unsigned int auto_chunk; /* < chunk size chosen by -b auto */
+
+	/* -M: datagrams sent respective received, tx_calls and
+	 * rx_calls are the sendmmsg() respective recvmmsg() calls */
+	unsigned long long total_tx_msgs;
+	unsigned long long total_rx_msgs;
+
+	/* UDP GSO/GRO (-G): segment size and reads of coalesced datagrams */
+	unsigned int gso_size;
+	unsigned long long gro_reads;
+
+	/* --rate: bucket size and whether SO_MAX_PACING_RATE was accepted */
+	unsigned int rate_burst;
+	bool rate_kernel;
+
+	/* sequenced udp (-S): receiver side loss, duplicate and reorder
+	 * accounting. Sequence numbers below the window are late, they
+	 * were already counted as lost. */
+	struct seq_stat {
+		unsigned long long received;
+		unsigned long long expected;
+		unsigned long long lost;
+		unsigned long long dups;
+		unsigned long long late;
+		unsigned long long reordered;
+		unsigned long long reorder_max; /* < largest reorder distance */
+		unsigned long long gap_max;     /* < longest run of lost datagrams */
+		double jitter_us;               /* < interarrival jitter (RFC 3550) */
+		bool enabled;                   /* < peer sends sequenced datagrams */
+		bool end_seen;
+	} seq;
+
+	/* forward error correction (-F): parity datagrams sent
+	 * respective received, data datagrams rebuilt from them and
+	 * blocks which lost more than the parity could cover */
+	struct fec_stat {
+		unsigned long long parity;
+		unsigned long long recovered;
+		unsigned long long unrecoverable;
+	} fec;
+
+	/* reliable multicast (-R): the transmitter side keeps one
+	 * entry per receiver which answered a poll, the receiver side
+	 * counts its own NAKs and the repairs. */
+	struct nak_stat {
+		unsigned int rounds;
+		unsigned int acked;             /* < receivers with the complete file */
+		unsigned long long naks;
+		unsigned long long repairs;     /* < repair datagrams sent respective written */
+		unsigned long long repair_dups; /* < repairs for data already present */
+		unsigned int npeers;
+		struct nak_peer {
+			char addr[INET6_ADDRSTRLEN + 16]; /* < address and receiver id */
+			struct sockaddr_storage ss;
+			uint32_t id;
+			unsigned long long naks;
+			unsigned long long requested; /* < datagrams NAKed by this receiver */
+			unsigned int done_round;      /* < round of the acknowledgement, 0 if none */
+		} *peer;
+	} nak;
+
+	unsigned int streams; /* number of parallel streams (-P) */
+
+	/* receive --daemon: senders received completely, connections
+	 * which ended before the announced data arrived (or at the
+	 * shutdown), senders turned away and the most concurrent ones */
+	unsigned long long conn_complete;
+	unsigned long long conn_incomplete;
+	unsigned long long conn_rejected;
+	unsigned int conn_peak;
+
 	struct use_stat use_stat_start;
 	struct use_stat use_stat_end;
 };
@@ -228,7 +389,26 @@ struct net_stat {
  * information like data size, rtt information,
  * ... */
 struct peer_header_info {
-	unsigned int data_size; /* < the size of the incoming data */
+	unsigned long long data_size; /* < the size of the incoming data */
+	unsigned int stream_index; /* < parallel stream (-P) of this connection */
+	unsigned int stream_count; /* < total number of parallel streams */
+	unsigned long long stream_offset; /* < file offset of the stream data */
+	bool sequenced; /* < datagrams carry a struct ns_seq (udp -S) */
+	bool nak; /* < lost datagrams are repaired on request (udp -R) */
+};
+
+/* A stream is the part of the file which is transmitted
+ * over one connection. Without -P there is one stream
+ * covering the whole file, with -P the file is cut into
+ * consecutive slices - one per thread and connection.
+ * Each stream accounts to its own statistic block, the
+ * blocks are merged after all threads are joined. */
+struct stream_desc {
+	unsigned int index;
+	unsigned int count;
+	off_t offset; /* < first byte of the slice */
+	off_t size;   /* < slice length, 0 means "until EOF" */
+	struct net_stat *ns;
 };
 
 /* Command-line options */
@@ -299,14 +479,22 @@ struct opts {
 	const char *outfile;
 	enum workmode  workmode;
 	enum io_call   io_call;
+	unsigned long  io_flags; /* < IOF_* modifier of io_call */
+	int            io_depth; /* < requests in flight for queued io calls */
+	int            pipe_size; /* < splice pipe size, 0 means pipe-max-size */
+	long long      mmap_window; /* < mmap window size, 0 means default */
 
 	/* if user set multiple_barrier then
 	** (buffer_size * multiple_barrier)
 	** is the maximum transfer amount
 	*/
 	int buffer_size;
+	bool buffer_auto; /* < -b auto: probe chunk sizes at transfer start */
 	int multiple_barrier;
 
+	unsigned long long rate; /* < --rate: transmit rate limit in bit/s, 0 = unlimited */
+	unsigned long long sync_window; /* < --sync: receiver writeback window, 0 = final fsync only */
+
 	int	sched_user; /* this is true if user wan't to change scheduling */
 	int sched_policy;
 	int priority;
@@ -314,8 +502,16 @@ struct opts {
 
 	long int udplite_checksum_coverage;
 
+	unsigned int mmsg_batch; /* < UDP: datagrams per sendmmsg/recvmmsg call, 0 disables -M */
+	bool udp_gso; /* < UDP transmit: segmentation offload (-G) */
+	bool udp_gro; /* < UDP receive: receive offload (-G) */
+	bool udp_seq; /* < UDP transmit: sequence numbered datagrams (-S) */
+	unsigned int nak_receivers; /* < UDP transmit: reliable multicast to this many receivers (-R) */
+	struct fec_code fec; /* < UDP transmit: forward error correction (-F) */
+
 	bool tcp_use_md5sig;
 	const char *tcp_md5sig_peeraddr; /* receive mode: need ip addr of peer allowed to connect */
+	bool rx_daemon; /* < receive --daemon: serve senders until SIGINT/SIGTERM, outfile is the template */
 
 #define	DEFAULT_RTT_FILTER 4
 
@@ -328,6 +524,13 @@ struct opts {
 	} rtt_probe_opt;
 	int perform_rtt_probe;
 
+	/* --busy-poll: SO_BUSY_POLL time in microseconds (0 = off), the
+	 * SO_BUSY_POLL_BUDGET (0 = kernel default) and whether the rtt
+	 * probes spin on non-blocking reads */
+	unsigned int busy_poll_usec;
+	unsigned int busy_poll_budget;
+	bool busy_poll_spin;
+
 	/* server read() delay parameters in seconds */
 	int delay_read_initial;
 	int delay_read;
@@ -374,6 +577,9 @@ touch_use_stat(enum where_send where, struct use_stat *use_stat)
 /* file.c */
 int open_input_file(void);
 int open_output_file(void);
+unsigned long long prealloc_output_file(int, unsigned long long, unsigned long long, bool);
+int open_conn_output_file(const char *, const char *, const char *, unsigned long long,
+		char *, size_t);
 
 /* getopt.c */
 void usage(void);
@@ -382,10 +588,12 @@ void parse_opts(int, char **, struct opts *);
 /* net.c */
 int get_sock_opts(int, struct net_stat *);
 int set_nodelay(int, int);
+int set_busy_poll(int, unsigned int, unsigned int);
 void set_socketopts(int fd);
 
 /* ns_hdr.c */
 int meta_exchange_snd(int, int);
+int meta_exchange_snd_stream(int, int, const struct stream_desc *);
 int meta_exchange_rcv(int, struct peer_header_info **);
 
 /* receive.c */
@@ -393,6 +601,10 @@ void receive_mode(void);
 
 /* trans_common.c */
 void trans_start(int, int);
+void trans_stream(int, int, struct stream_desc *);
 void ip_stream_trans_mode(struct opts*);
+int grow_pipe(int);
+bool ring_wait(uint32_t *, uint32_t, uint32_t *);
+void ring_publish(uint32_t *, uint32_t, uint32_t *);
 
 /* vim:set ts=4 sw=4 sts=4 tw=78 ff=unix noet: */
@@ -55,6 +55,7 @@ struct conf_map_t io_call_map[] = {
 	{ IO_SENDFILE,	"sendfile"  },
 	{ IO_SPLICE,	"splice"  },
 	{ IO_RW,		"rw"		},
+	{ IO_URING,		"uring"		},
 };
 
 static int conv_ip_mtu_discover(const char *s)
@@ -116,7 +117,7 @@ struct sock_callbacks sock_callbacks = {
 	.cb_listen = listen
 };
 
-#define	MAX_STATLEN 4096
+#define	MAX_STATLEN 8192
 
 
 static void
@@ -44,7 +44,7 @@ extern struct socket_options socket_options[];
 int
 set_nodelay(int fd, int flag)
 {
-	int ret = 0; socklen_t ret_size;
+	int ret = 0; socklen_t ret_size = sizeof(ret);
 
 	if (getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ret, &ret_size) < 0)
 		return -1;
@@ -56,6 +56,41 @@ set_nodelay(int fd, int flag)
 }
 
 
+#ifndef SO_PREFER_BUSY_POLL
+# define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+# define SO_BUSY_POLL_BUDGET 70
+#endif
+
+/* let blocking reads on the socket poll the device queue for usec
+** microseconds (0 disables busy polling) instead of sleeping until
+** the interrupt, prefer busy polling over interrupt driven NAPI and
+** poll up to budget packets at once (0 keeps the kernel default).
+** Return -1 if an option is refused
+*/
+int
+set_busy_poll(int fd, unsigned int usec, unsigned int budget)
+{
+	int val = usec, prefer = usec > 0;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)) < 0)
+		return -1;
+
+	/* since Linux 5.11 */
+	if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) < 0)
+		msg(LOUDISH, "can't set SO_PREFER_BUSY_POLL: %s", strerror(errno));
+
+	if (budget && usec) {
+		val = budget;
+		if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &val, sizeof(val)) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
 static int
 get_ip_sock_opts(int fd, struct net_stat *ns)
 {
@@ -198,6 +233,10 @@ void set_socketopts(int fd)
 			err_sys_die(EXIT_FAILMISC, "setsockopt option %d (name %s) failed", socket_options[i].sockopt_type,
 										socket_options[i].sockopt_name);
 	}
+
+	if (opts.busy_poll_usec &&
+		set_busy_poll(fd, opts.busy_poll_usec, opts.busy_poll_budget))
+		err_sys("Can't enable busy polling (needs CAP_NET_ADMIN above the sysctl)");
 }
 
 
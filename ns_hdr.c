@@ -93,15 +93,76 @@ out:
 	return total > 0 ? total : -1;
 }
 
+/* readn() spinning on non-blocking reads instead of sleeping until
+** the data arrives (--busy-poll USEC:spin) */
+static ssize_t spin_readn(int fd, void *buf, size_t buflen)
+{
+	char *bufptr = buf;
+	ssize_t total = 0;
+	do {
+		ssize_t ret = recv(fd, bufptr, buflen, MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				continue;
+			break;
+		}
+		if (ret == 0)
+			break;
+
+		total += ret;
+		bufptr += ret;
+		buflen -= ret;
+	} while (buflen > 0);
+
+	return total > 0 ? total : -1;
+}
+
+/* the receiver follows the busy polling of the transmitters probes */
+static bool rx_busy_poll = true;
+
+static ssize_t probe_readn(int fd, void *buf, size_t buflen, bool busy)
+{
+	if (busy && opts.busy_poll_spin)
+		return spin_readn(fd, buf, buflen);
+	return readn(fd, buf, buflen);
+}
+
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* percentiles of n rtt samples in milliseconds */
+static void
+latency_dist(struct latency_dist *dist, const double *rtt_ms, int n)
+{
+	double *sorted = xmalloc(n * sizeof(*sorted));
+
+	memcpy(sorted, rtt_ms, n * sizeof(*sorted));
+	qsort(sorted, n, sizeof(*sorted), cmp_double);
+
+	dist->samples = n;
+	dist->min = sorted[0] * 1000;
+	dist->p50 = sorted[(n - 1) * 50 / 100] * 1000;
+	dist->p90 = sorted[(n - 1) * 90 / 100] * 1000;
+	dist->p99 = sorted[(n - 1) * 99 / 100] * 1000;
+	dist->max = sorted[n - 1] * 1000;
+	free(sorted);
+}
+
 /* This is the plan:
 ** send n rtt packets into the wire and wait until all n reply packets
 ** arrived. If a timeout occur we count this packet as lost
 */
 static int
-probe_rtt(int peer_fd, int next_hdr, int probe_no, uint16_t backing_data_size)
+probe_rtt(int peer_fd, int next_hdr, int probe_no, uint16_t backing_data_size,
+		bool busy, struct latency_dist *dist)
 {
 	int i, j, current_next_hdr;
-	double rtt_ms[probe_no + 1], deviation = 0, covariance = 0;
+	double *rtt_ms, deviation = 0, covariance = 0;
 	double d_tmp = 0;
 	uint16_t packet_len; ssize_t to_write;
 	char rtt_buf[backing_data_size + sizeof(struct ns_rtt_probe)];
@@ -111,6 +172,9 @@ probe_rtt(int peer_fd, int next_hdr, int probe_no, uint16_t backing_data_size)
 	if (probe_no <= 0)
 		err_msg_die(EXIT_FAILINT, "Programmed Failure");
 
+	/* -r allows up to 10000 probes, too much for the stack */
+	rtt_ms = xmalloc(probe_no * sizeof(*rtt_ms));
+
 	memset(ns_rtt_probe, 0, sizeof(struct ns_rtt_probe));
 	memset(data_ptr, 'A', backing_data_size);
 
@@ -138,13 +202,15 @@ probe_rtt(int peer_fd, int next_hdr, int probe_no, uint16_t backing_data_size)
 		char reply_buf[to_write];
 		struct ns_rtt_probe *ns_rtt_reply;
 		ssize_t to_read = to_write;
-		struct timeval tv, tv_tmp, tv_res;
+		struct timeval tv;
+		struct timespec ts_start, ts_end;
 
 		if (i++ >= probe_no)
 			current_next_hdr = next_hdr;
 
 		ns_rtt_probe->nse_nxt_hdr = htons(current_next_hdr);
-		ns_rtt_probe->type = (htons((uint16_t)RTT_REQUEST_TYPE));
+		ns_rtt_probe->type = htons((uint16_t) (busy ? RTT_REQUEST_BUSY_TYPE :
+					RTT_REQUEST_TYPE));
 		ns_rtt_probe->seq_no = htons(i);
 
 		/* set timeval for packet */
@@ -154,24 +220,25 @@ probe_rtt(int peer_fd, int next_hdr, int probe_no, uint16_t backing_data_size)
 		ns_rtt_probe->sec = htonl(tv.tv_sec);
 		ns_rtt_probe->usec = htonl(tv.tv_usec);
 
+		/* the rtt itself is taken from the monotonic clock, the
+		 * microseconds of busy polling don't vanish in the resolution
+		 * of the timestamps in the probe */
+		clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
 		/* transmitt rtt probe ... */
 		if (writen(peer_fd, ns_rtt_probe, to_write) != to_write)
 			err_msg_die(EXIT_FAILHEADER, "Can't send rtt extension header!\n");
 
 		/* ... and receive probe */
-		if (readn(peer_fd, reply_buf, to_read) != to_read)
+		if (probe_readn(peer_fd, reply_buf, to_read, busy) != to_read) {
+			free(rtt_ms);
 			return -1;
+		}
 
-		if (gettimeofday(&tv, NULL) != 0)
-			err_sys("Can't call gettimeofday");
+		clock_gettime(CLOCK_MONOTONIC, &ts_end);
 
 		ns_rtt_reply = (struct ns_rtt_probe *) reply_buf;
 
-		tv_tmp.tv_sec = ntohl(ns_rtt_reply->sec);
-		tv_tmp.tv_usec = ntohl(ns_rtt_reply->usec);
-
-		subtime(&tv_tmp, &tv, &tv_res);
-
 		/* sanity check (ident) */
 		if (ntohs(ns_rtt_reply->ident) != (getpid() & 0xffff))
 			err_msg("received a unknown rtt probe reply (ident  should: %d is: %d)",
@@ -183,14 +250,18 @@ probe_rtt(int peer_fd, int next_hdr, int probe_no, uint16_t backing_data_size)
 		if (i == 1)
 			continue;
 
-		rtt_ms[i - 2] = (tv_res.tv_sec * 1000) + ((double)tv_res.tv_usec / 1000);
+		rtt_ms[i - 2] = (ts_end.tv_sec - ts_start.tv_sec) * 1000 +
+			(double) (ts_end.tv_nsec - ts_start.tv_nsec) / 1000000;
 
 		msg(STRESSFUL, "receive rtt reply probe (sequence: %d, len %d, rtt: %.3fms)",
 				ntohs(ns_rtt_reply->seq_no), to_read, rtt_ms[i - 2]);
 
 	}
 
+	latency_dist(dist, rtt_ms, probe_no);
+
 	/* average */
+	net_stat.rtt_probe.usec = 0;
 	for (j = 0; j < probe_no; j++)
 		net_stat.rtt_probe.usec += rtt_ms[j];
 
@@ -223,6 +294,7 @@ probe_rtt(int peer_fd, int next_hdr, int probe_no, uint16_t backing_data_size)
 	msg(LOUDISH, "average rtt: %.3fms (after filter), covariance: %.3fms^2, standard deviation %.3fms",
 			net_stat.rtt_probe.usec, covariance, deviation);
 
+	free(rtt_ms);
 	return 0;
 }
 
@@ -253,6 +325,28 @@ send_rtt_info(int fd, int next_hdr, struct rtt_probe *rtt_probe)
 	return -1;
 }
 
+static void
+send_stream_info(int fd, int next_hdr, const struct stream_desc *sd)
+{
+	ssize_t len = sizeof(struct ns_nxt_stream);
+	struct ns_nxt_stream ns_nxt_stream;
+	unsigned long long offset = sd->offset, size = sd->size;
+
+	memset(&ns_nxt_stream, 0, sizeof(ns_nxt_stream));
+
+	ns_nxt_stream.nse_nxt_hdr = htons(next_hdr);
+	ns_nxt_stream.nse_len = htons((len - 4) / 4);
+	ns_nxt_stream.index = htons(sd->index);
+	ns_nxt_stream.count = htons(sd->count);
+	ns_nxt_stream.offset_hi = htonl(offset >> 32);
+	ns_nxt_stream.offset_lo = htonl(offset & 0xffffffff);
+	ns_nxt_stream.size_hi = htonl(size >> 32);
+	ns_nxt_stream.size_lo = htonl(size & 0xffffffff);
+
+	if (writen(fd, &ns_nxt_stream, len) != len)
+		err_msg_die(EXIT_FAILHEADER, "Can't send stream extension header!\n");
+}
+
 /**
  * meta_exchange_snd send header(s) information to the
  * peer node. We definitive send our netsend header and
@@ -263,13 +357,26 @@ send_rtt_info(int fd, int next_hdr, struct rtt_probe *rtt_probe)
 
 int
 meta_exchange_snd(int connected_fd, int file_fd)
+{
+	return meta_exchange_snd_stream(connected_fd, file_fd, NULL);
+}
+
+/**
+ * meta_exchange_snd_stream is the parallel stream (-P) variant
+ * of meta_exchange_snd: sd describes the slice of the file this
+ * connection carries. Rtt probes are performed by the first
+ * stream only.
+*/
+
+int
+meta_exchange_snd_stream(int connected_fd, int file_fd, const struct stream_desc *sd)
 {
 	int ret = 0;
 	ssize_t len;
 	ssize_t file_size;
 	struct ns_hdr ns_hdr;
 	struct stat stat_buf;
-	int perform_rtt;
+	int perform_rtt, data_hdr;
 
 	memset(&ns_hdr, 0, sizeof(struct ns_hdr));
 
@@ -277,6 +384,8 @@ meta_exchange_snd(int connected_fd, int file_fd)
 	xfstat(file_fd, &stat_buf, opts.infile);
 
 	file_size = S_ISREG(stat_buf.st_mode) ? stat_buf.st_size : 0;
+	if (sd)
+		file_size = sd->size;
 
 
 	ns_hdr.magic = htons(NS_MAGIC);
@@ -285,16 +394,24 @@ meta_exchange_snd(int connected_fd, int file_fd)
 	ns_hdr.data_size = htonl(file_size);
 
 	perform_rtt = (opts.rtt_probe_opt.iterations > 0) ? 1 : 0;
+	if (sd && sd->index != 0)
+		perform_rtt = 0;
 
+	data_hdr = perform_rtt ? NSE_NXT_RTT_PROBE : NSE_NXT_DATA;
 
-	ns_hdr.nse_nxt_hdr = perform_rtt ? htons(NSE_NXT_RTT_PROBE) : htons(NSE_NXT_DATA);
+	ns_hdr.nse_nxt_hdr = sd ? htons(NSE_NXT_STREAM) : htons(data_hdr);
+	ns_hdr.flags = htons((opts.udp_seq ? NS_HDR_F_SEQ : 0) |
+			(opts.nak_receivers ? NS_HDR_F_NAK : 0));
 
 	len = sizeof(struct ns_hdr);
 	if (writen(connected_fd, &ns_hdr, len) != len)
 		err_msg_die(EXIT_FAILHEADER, "Can't send netsend header!\n");
 
+	if (sd)
+		send_stream_info(connected_fd, data_hdr, sd);
+
 	/* probe for effective round trip time */
-	if (opts.rtt_probe_opt.iterations > 0) {
+	if (perform_rtt) {
 
 		int flag_old;
 		struct sigaction sa;
@@ -315,8 +432,20 @@ meta_exchange_snd(int connected_fd, int file_fd)
 		}
 
 		alarm(TIMEOUT_SEC);
-		probe_rtt(connected_fd, NSE_NXT_DATA,
-				opts.rtt_probe_opt.iterations, opts.rtt_probe_opt.data_size);
+		if (opts.busy_poll_usec) {
+			/* the same probes without busy polling first, then with it */
+			if (set_busy_poll(connected_fd, 0, 0))
+				err_sys("Can't disable busy polling");
+			probe_rtt(connected_fd, NSE_NXT_RTT_PROBE, opts.rtt_probe_opt.iterations,
+					opts.rtt_probe_opt.data_size, false, &net_stat.latency[0]);
+			if (set_busy_poll(connected_fd, opts.busy_poll_usec, opts.busy_poll_budget))
+				err_sys("Can't enable busy polling");
+			probe_rtt(connected_fd, NSE_NXT_DATA, opts.rtt_probe_opt.iterations,
+					opts.rtt_probe_opt.data_size, true, &net_stat.latency[1]);
+		} else {
+			probe_rtt(connected_fd, NSE_NXT_DATA, opts.rtt_probe_opt.iterations,
+					opts.rtt_probe_opt.data_size, false, &net_stat.latency[0]);
+		}
 		alarm(0);
 
 		/* and restore TCP_NOPUSH */
@@ -356,6 +485,18 @@ process_rtt_probe(int peer_fd, uint16_t nse_len)
 	msg(STRESSFUL, "process rtt probe (sequence: %d, type: %d packet_size: %d)",
 			ntohs(ns_rtt_probe_ptr->seq_no), ntohs(ns_rtt_probe_ptr->type), to_read);
 
+	/* busy poll in the same rounds as the transmitter (--busy-poll) */
+	if (opts.busy_poll_usec) {
+		bool busy = ntohs(ns_rtt_probe_ptr->type) == RTT_REQUEST_BUSY_TYPE;
+
+		if (busy != rx_busy_poll) {
+			if (set_busy_poll(peer_fd, busy ? opts.busy_poll_usec : 0,
+						opts.busy_poll_budget))
+				err_sys("Can't switch busy polling");
+			rx_busy_poll = busy;
+		}
+	}
+
 	ns_rtt_probe_ptr->type = htons(RTT_REPLY_TYPE);
 
 	intptr = (uint16_t *)buf;
@@ -364,8 +505,10 @@ process_rtt_probe(int peer_fd, uint16_t nse_len)
 	intptr = (uint16_t *)buf + sizeof(uint16_t);
 	*intptr = htons(nse_len);
 
-	if (writen(peer_fd, buf, to_read + 4) != to_read + 4)
-		err_msg_die(EXIT_FAILHEADER, "Can't reply to rtt probe!\n");
+	if (writen(peer_fd, buf, to_read + 4) != to_read + 4) {
+		err_msg("Can't reply to rtt probe!\n");
+		return -1;
+	}
 
 	return ret;
 }
@@ -388,6 +531,41 @@ process_rtt_info(int peer_fd, uint16_t nse_len)
 }
 
 
+static int
+process_stream_info(int peer_fd, uint16_t nse_len, struct peer_header_info *phi)
+{
+	struct ns_nxt_stream ns_nxt_stream;
+	ssize_t to_read = nse_len * 4;
+
+	if (to_read != sizeof(ns_nxt_stream) - 4) {
+		err_msg("stream extension header has wrong size (%d byte)", to_read);
+		return -1;
+	}
+
+	if (readn(peer_fd, (char *) &ns_nxt_stream + 4, to_read) != to_read)
+		return -1;
+
+	phi->stream_index = ntohs(ns_nxt_stream.index);
+	phi->stream_count = ntohs(ns_nxt_stream.count);
+	phi->stream_offset = ((unsigned long long) ntohl(ns_nxt_stream.offset_hi) << 32) |
+		ntohl(ns_nxt_stream.offset_lo);
+	phi->data_size = ((unsigned long long) ntohl(ns_nxt_stream.size_hi) << 32) |
+		ntohl(ns_nxt_stream.size_lo);
+
+	if (phi->stream_count == 0 || phi->stream_count > MAX_STREAMS ||
+		phi->stream_index >= phi->stream_count) {
+		err_msg("received an invalid stream extension header (stream %u of %u)",
+				phi->stream_index, phi->stream_count);
+		return -1;
+	}
+
+	msg(STRESSFUL, "stream %u of %u (offset: %llu, size: %llu)", phi->stream_index,
+			phi->stream_count, phi->stream_offset, phi->data_size);
+
+	return 0;
+}
+
+
 static int
 process_nonxt(int peer_fd, uint16_t nse_len)
 {
@@ -418,6 +596,7 @@ meta_exchange_rcv(int peer_fd, struct peer_header_info **hi)
 
 	/* allocate info header */
 	phi = xzalloc(sizeof(struct peer_header_info));
+	phi->stream_count = 1;
 	*hi = phi;
 
 	ptr = (unsigned char *) &ns_hdr;
@@ -430,14 +609,17 @@ meta_exchange_rcv(int peer_fd, struct peer_header_info **hi)
 
 	/* ns header is in -> sanity checks and look if peer specified extension header */
 	if (ntohs(ns_hdr.magic) != NS_MAGIC) {
-		err_msg_die(EXIT_FAILHEADER, "received an corrupted header"
+		err_msg("received an corrupted header"
 				"(should %d but is %d)!\n", NS_MAGIC, ntohs(ns_hdr.magic));
+		return -1;
 	}
 
 	msg(STRESSFUL, "header info (magic: %d, version: %d, data_size: %d)",
 			ntohs(ns_hdr.magic), ntohs(ns_hdr.version), ntohl(ns_hdr.data_size));
 
 	phi->data_size = ntohl(ns_hdr.data_size);
+	phi->sequenced = !!(ntohs(ns_hdr.flags) & NS_HDR_F_SEQ);
+	phi->nak = phi->sequenced && (ntohs(ns_hdr.flags) & NS_HDR_F_NAK);
 
 
 	extension_type = ntohs(ns_hdr.nse_nxt_hdr);
@@ -457,7 +639,8 @@ meta_exchange_rcv(int peer_fd, struct peer_header_info **hi)
 		** there IS a extension header and a extension header is always
 		** 4 byte
 		*/
-		if (readn(peer_fd, common_ext_head, to_read) != to_read)
+		if (probe_readn(peer_fd, common_ext_head, to_read,
+					opts.busy_poll_usec && rx_busy_poll) != to_read)
 			return -1;
 
 		extension_size = ntohs(common_ext_head[1]);
@@ -484,6 +667,13 @@ meta_exchange_rcv(int peer_fd, struct peer_header_info **hi)
 					return -1;
 				break;
 
+			case NSE_NXT_STREAM:
+				msg(STRESSFUL, "next extension header: %s", "NSE_NXT_STREAM");
+				ret = process_stream_info(peer_fd, extension_size, phi);
+				if (ret == -1)
+					return -1;
+				break;
+
 			case NSE_NXT_RTT_INFO:
 				msg(STRESSFUL, "next extension header: %s", "NSE_NXT_RTT_INFO");
 				ret = process_rtt_info(peer_fd, extension_size);
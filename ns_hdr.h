@@ -25,15 +25,82 @@
 #define	NS_MAGIC 0x67
 
 enum ns_nse_nxt { NSE_NXT_DATA, NSE_NXT_DIGEST, NSE_NXT_RTT_PROBE,
-		NSE_NXT_NONXT, NSE_NXT_RTT_INFO
+		NSE_NXT_NONXT, NSE_NXT_RTT_INFO, NSE_NXT_STREAM
 };
 
+/* ns_hdr flags */
+#define	NS_HDR_F_SEQ 0x0001 /* every data datagram starts with struct ns_seq */
+#define	NS_HDR_F_NAK 0x0002 /* NAK based repair of lost datagrams (udp -R) */
+
 struct ns_hdr {
 	uint16_t magic;
 	uint16_t version;
 	uint32_t data_size; /* purely data, without netsend header */
 	uint16_t nse_nxt_hdr; /* NSE_NXT_DATA for no header */
-	uint16_t unused;
+	uint16_t flags; /* NS_HDR_F_* */
+} __attribute__((packed));
+
+/* ns_seq prefixes every datagram of a sequenced udp transfer (-S).
+** The data of datagram seq belongs at file offset seq * seg. The
+** send time is CLOCK_REALTIME, a datagram with NS_SEQ_END carries
+** no data and seq is the number of data datagrams sent.
+*/
+#define	NS_SEQ_END    0x0001
+#define	NS_SEQ_POLL   0x0002 /* request feedback, followed by struct ns_nak_poll */
+#define	NS_SEQ_REPAIR 0x0004 /* retransmission of a NAKed datagram */
+#define	NS_SEQ_PARITY 0x0008 /* fec parity of block seq, struct ns_fec and parity follow */
+#define	NS_SEQ_FEC    0x0010 /* fec code announcement, struct ns_fec follows */
+
+struct ns_seq {
+	uint32_t  seq_hi;
+	uint32_t  seq_lo;
+	uint32_t  sec;
+	uint32_t  nsec;
+	uint16_t  flags; /* NS_SEQ_* */
+	uint16_t  seg;   /* data bytes of a full datagram */
+} __attribute__((packed));
+
+/* Forward error correction (-F): the code is announced before
+** the data and repeated in every parity datagram. count and
+** tail_len describe the data datagrams of the block, only the
+** last block of a file is short.
+*/
+struct ns_fec {
+	uint8_t   type;  /* enum fec_type */
+	uint8_t   n;
+	uint8_t   k;
+	uint8_t   index; /* parity datagram of the block */
+	uint16_t  count;
+	uint16_t  tail_len;
+} __attribute__((packed));
+
+/* Reliable multicast (-R): after the data the transmitter polls
+** the receivers in rounds. Every receiver answers a poll with a
+** struct ns_nak, unicast to the source address of the poll and
+** the feedback port. It lists up to NS_NAK_MAX_RANGES ranges of
+** missing datagrams, no range at all acknowledges the complete
+** file. The NAKed datagrams are multicast again as repairs.
+*/
+#define	NS_NAK_MAX_RANGES 64
+
+struct ns_nak_poll {
+	uint32_t  round;
+	uint16_t  port;  /* feedback port of the transmitter */
+	uint16_t  reserved;
+} __attribute__((packed));
+
+struct ns_nak_range {
+	uint32_t  start_hi;
+	uint32_t  start_lo;
+	uint32_t  count;
+} __attribute__((packed));
+
+struct ns_nak {
+	uint16_t  magic; /* NS_MAGIC */
+	uint16_t  nranges;
+	uint32_t  round;
+	uint32_t  id;    /* random, tells receivers behind one address apart */
+	struct ns_nak_range range[NS_NAK_MAX_RANGES];
 } __attribute__((packed));
 
 /*
@@ -77,7 +144,9 @@ struct ns_nxt_nonxt {
 
 /* rtt packet */
 
-enum ns_rtt_type { RTT_REQUEST_TYPE = 0, RTT_REPLY_TYPE };
+/* RTT_REQUEST_BUSY_TYPE: the transmitter probes with busy polling,
+ * the receiver busy polls as well (--busy-poll) */
+enum ns_rtt_type { RTT_REQUEST_TYPE = 0, RTT_REPLY_TYPE, RTT_REQUEST_BUSY_TYPE };
 
 struct ns_rtt_probe {
 	uint16_t  nse_nxt_hdr; /* next header */
@@ -91,6 +160,23 @@ struct ns_rtt_probe {
 	/* variable data */
 } __attribute__((packed));
 
+/* ns_nxt_stream announces that this connection carries one
+** slice of a file transmitted over several parallel streams (-P).
+** The receiver writes the data at offset into the output file.
+** 64 bit values are split into two 32 bit words (high word first).
+*/
+
+struct ns_nxt_stream {
+	uint16_t  nse_nxt_hdr; /* next header */
+	uint16_t  nse_len; /* length in units of 4 octets (not including the first 4 octets) */
+	uint16_t  index; /* stream number, 0 .. count - 1 */
+	uint16_t  count; /* total number of streams */
+	uint32_t  offset_hi;
+	uint32_t  offset_lo;
+	uint32_t  size_hi;
+	uint32_t  size_lo;
+} __attribute__((packed));
+
 struct ns_rtt_info {
 	uint16_t  nse_nxt_hdr; /* next header */
 	uint16_t  nse_len; /* ... you know */
@@ -22,6 +22,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
 
 #include "global.h"
 #include "xfuncs.h"
@@ -56,6 +57,19 @@ void udplite_setsockopt_recv_csov(int connected_fd, uint16_t coverage)
 }
 
 
+/* let the stack coalesce datagrams of a flow, recvmsg() then
+** reports the segment size in an UDP_GRO control message */
+void udp_setsockopt_gro(int fd)
+{
+	int on = 1;
+
+	if (setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)))
+		err_sys_die(EXIT_FAILNET, "setsockopt option UDP_GRO failed"
+				" (kernel without UDP GRO?)");
+	msg(GENTLE, "enable UDP GRO");
+}
+
+
 /* Creates our server socket and initialize
 ** options
 */
@@ -165,7 +179,71 @@ static int init_udp_trans(const struct opts *optsp)
 	return fd;
 }
 
+extern struct opts opts;
 extern struct net_stat net_stat;
+
+/* the largest datagram payload which fits the path MTU of a
+** connected socket or 0 if the kernel doesn't tell us */
+static unsigned int udp_path_payload(int fd, int family)
+{
+	int mtu;
+	socklen_t len = sizeof(mtu);
+
+	switch (family) {
+	case AF_INET6:
+		if (getsockopt(fd, IPPROTO_IPV6, IPV6_MTU, &mtu, &len) < 0)
+			return 0;
+		return mtu - 40 - 8;
+	case AF_INET:
+		if (getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &len) < 0)
+			return 0;
+		return mtu - 20 - 8;
+	default:
+		return 0;
+	}
+}
+
+
+/* UDP GSO: the socket gets a segment size via UDP_SEGMENT, every
+** write of a super buffer is cut into datagrams of this size by
+** the stack - or by the NIC. The segment size is the path payload,
+** the user may lower it with -b.
+*/
+static void udp_gso_setup(int fd)
+{
+	struct sockaddr_storage ss;
+	socklen_t ss_len = sizeof(ss);
+	unsigned int seg;
+	int val;
+
+	if (getsockname(fd, (struct sockaddr *) &ss, &ss_len))
+		err_sys_die(EXIT_FAILNET, "getsockname");
+
+	/* a segment above the MTU fails every send with EINVAL */
+	seg = udp_path_payload(fd, ss.ss_family);
+	if (seg == 0) {
+		seg = ss.ss_family == AF_INET6 ? UDP_SAFE_PAYLOAD6 : UDP_SAFE_PAYLOAD4;
+		msg(GENTLE, "UDP GSO: path MTU unknown, assume %u byte segments", seg);
+	}
+	if (seg > UDP_MAX_PAYLOAD)
+		seg = UDP_MAX_PAYLOAD;
+	if (opts.buffer_size > 0 && (unsigned int) opts.buffer_size < seg)
+		seg = opts.buffer_size;
+
+	val = seg;
+	if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)))
+		err_sys_die(EXIT_FAILNET, "setsockopt option UDP_SEGMENT failed"
+				" (kernel without UDP GSO?)");
+
+	if (UDP_GSO_BUFLEN(seg) == seg)
+		msg(GENTLE, "UDP GSO: segment size %u leaves room for one segment per send,"
+				" lower it with -b", seg);
+
+	msg(GENTLE, "UDP GSO: %u byte segments, %u byte per send",
+			seg, UDP_GSO_BUFLEN(seg));
+	net_stat.gso_size = seg;
+}
+
 /*
 ** o initialize server socket
 ** o fstat and open our sending-file
@@ -188,6 +266,9 @@ udp_trans_mode(struct opts *optsp)
 	/* construct and send netsend header to peer */
 	meta_exchange_snd(connected_fd, file_fd);
 
+	if (optsp->udp_gso)
+		udp_gso_setup(connected_fd);
+
 	trans_start(file_fd, connected_fd);
 }
 
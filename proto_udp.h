@@ -15,9 +15,36 @@
 # define UDPLITE_RECV_CSCOV   11
 #endif
 
+#ifndef SOL_UDP
+# define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+# define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+# define UDP_GRO 104
+#endif
+
+/* UDP GSO (-G): one send carries up to UDP_GSO_MAX_SEGS
+ * datagrams, the super datagram must fit into an IP packet */
+#define	UDP_GSO_MAX_SEGS    64U
+#define	UDP_MAX_PAYLOAD     65507U
+#define	UDP_GSO_BUFLEN(seg) (min(UDP_GSO_MAX_SEGS, UDP_MAX_PAYLOAD / (seg)) * (seg))
+
+/* payload of an ethernet sized datagram (1500 byte MTU), the segment
+ * size if the kernel doesn't know the path MTU */
+#define	UDP_SAFE_PAYLOAD4   1472U
+#define	UDP_SAFE_PAYLOAD6   1452U
+
+/* UDP GRO (-G receive): a read returns up to 64 KiB of coalesced datagrams */
+#define	UDP_GRO_BUFLEN      65536
+
 int udp_listen(int sockfd, int);
 
 void udplite_setsockopt_recv_csov(int connected_fd, uint16_t cov);
+void udp_setsockopt_gro(int fd);
 
 struct opts;
 void udp_trans_mode(struct opts*);
@@ -20,25 +20,41 @@
 ** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
+#define _GNU_SOURCE
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 
+#include "analyze.h"
 #include "global.h"
 #include "xfuncs.h"
+#include "ns_hdr.h"
 #include "proto_tcp.h"
 #include "proto_udp.h"
 #include "proto_tipc.h"
 #include "proto_unix.h"
+#include "uring.h"
 
 extern struct opts opts;
 extern struct net_stat net_stat;
@@ -46,59 +62,1757 @@ extern struct conf_map_t io_call_map[];
 extern struct socket_options socket_options[];
 extern struct sock_callbacks sock_callbacks;
 
+/* UDP GRO: the kernel hands out coalesced datagrams, the
+** segment size arrives as control message. A read without
+** it carries exactly one datagram, the segment size is len. */
+static unsigned int gro_seg_size(struct msghdr *mh, unsigned int len)
+{
+	struct cmsghdr *cmsg;
+	int seg;
+
+	for (cmsg = CMSG_FIRSTHDR(mh); cmsg; cmsg = CMSG_NXTHDR(mh, cmsg)) {
+		if (cmsg->cmsg_level != SOL_UDP || cmsg->cmsg_type != UDP_GRO)
+			continue;
+
+		memcpy(&seg, CMSG_DATA(cmsg), sizeof(seg));
+		if (seg <= 0 || (unsigned int) seg >= len)
+			break;
+
+		return seg;
+	}
+	return len;
+}
+
+
+static unsigned int gro_segments(struct msghdr *mh, unsigned int len,
+		struct net_stat *ns)
+{
+	unsigned int seg = gro_seg_size(mh, len);
+
+	if (seg == len)
+		return 1;
+
+	ns->gro_reads++;
+	ns->gso_size = max(ns->gso_size, seg);
+	return (len + seg - 1) / seg;
+}
+
+
+/* Batched datagram receive (-M): recvmmsg(2) pulls up to
+** opts.mmsg_batch datagrams into a preallocated array of
+** buffers, all of them are written with one writev(2).
+** MSG_WAITFORONE blocks for the first datagram only, so a
+** batch is never delayed waiting for the next one.
+** UDP GRO (-G) uses this path too - with a batch of one
+** if -M is not given - and counts the coalesced datagrams.
+*/
+static ssize_t
+cs_read_mmsg(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns, size_t buflen)
+{
+	unsigned int i, batch = opts.mmsg_batch ? opts.mmsg_batch : 1;
+	const size_t ctrllen = CMSG_SPACE(sizeof(int));
+	struct mmsghdr *msgs;
+	struct iovec *iov, *wiov;
+	char *buf, *ctrl = NULL;
+	int rc;
+
+	buf  = xmalloc(batch * buflen);
+	iov  = xmalloc(batch * sizeof(*iov));
+	wiov = xmalloc(batch * sizeof(*wiov));
+	msgs = xzalloc(batch * sizeof(*msgs));
+	if (opts.udp_gro)
+		ctrl = xzalloc(batch * ctrllen);
+
+	for (i = 0; i < batch; i++) {
+		iov[i].iov_base = buf + i * buflen;
+		iov[i].iov_len = buflen;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	for (;;) {
+		ssize_t ret, len = 0;
+
+		/* the kernel shrinks msg_controllen to the used size */
+		for (i = 0; ctrl && i < batch; i++) {
+			msgs[i].msg_hdr.msg_control = ctrl + i * ctrllen;
+			msgs[i].msg_hdr.msg_controllen = ctrllen;
+		}
+
+		rc = recvmmsg(connected_fd, msgs, batch, MSG_WAITFORONE, NULL);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+
+		ns->total_rx_calls++;
+
+		for (i = 0; i < (unsigned int) rc; i++) {
+			wiov[i].iov_base = iov[i].iov_base;
+			wiov[i].iov_len = msgs[i].msg_len;
+			len += msgs[i].msg_len;
+			ns->total_rx_msgs += ctrl ?
+				gro_segments(&msgs[i].msg_hdr, msgs[i].msg_len, ns) : 1;
+		}
+		ns->total_rx_bytes += len;
+
+		do {
+			ret = writev(file_fd, wiov, rc);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret != len) {
+			err_sys("write failed");
+			break;
+		}
+
+		/* see cs_read(): datagram protocols don't signal the end */
+		if (ns->total_rx_bytes >= phi->data_size && phi->data_size != 0)
+			break;
+
+		if (opts.delay_read) {
+			msg(LOUDISH, "delay recvmmsg() operation for %d seconds", opts.delay_read);
+			sleep(opts.delay_read);
+		}
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	if (rc < 0)
+		err_sys("recvmmsg failed");
+
+	free(ctrl);
+	free(msgs);
+	free(wiov);
+	free(iov);
+	free(buf);
+	return rc;
+}
+
+
+/* Sequenced datagram receive (-S on the transmitter side,
+** announced via NS_HDR_F_SEQ). Every datagram starts with a
+** struct ns_seq, the data of a regular output file is written
+** at seq * seg so reordered datagrams land in place and lost
+** ones leave a hole. Other outputs get the data in arrival
+** order. Receipt is tracked in a bitmap window of SEQ_WINDOW
+** sequence numbers, a sequence number is accounted as lost
+** when the window moves beyond it. The transfer ends with the
+** end marker or after SEQ_IDLE_TIMEOUT ms without a datagram.
+*/
+#define	SEQ_WINDOW 65536
+#define	SEQ_IDLE_TIMEOUT 3000 /* ms */
+#define	SEQ_END_GRACE 100 /* ms, stragglers behind the end marker */
+#define	SEQ_SLOT 65536 /* largest udp datagram */
+
+struct seq_track {
+	unsigned long long base; /* < lowest not yet accounted sequence number */
+	unsigned long long next; /* < highest seen sequence number + 1 */
+	unsigned long long run;  /* < current run of lost datagrams */
+	double last_transit;     /* < for the jitter, in us */
+	unsigned char *bits;
+	unsigned long long end;  /* < number of data datagrams, from end marker or poll */
+	int file_fd;
+	bool regular;
+
+	/* reliable multicast (-R): complete receipt map for the NAKs */
+	bool nak;
+	unsigned char *have;
+	size_t have_len;
+	unsigned int round;      /* < last answered poll */
+	uint32_t id;
+	int fb_fd;               /* < the data socket may be bound to the group */
+
+	/* forward error correction (-F), set up by the announcement */
+	bool fec_ready;
+	struct fec_rx fec;
+	bool write_failed;
+	struct net_stat *ns;
+};
+
+static void seq_retire(struct seq_track *st, struct seq_stat *ss,
+		unsigned long long upto)
+{
+	for (; st->base < upto; st->base++) {
+		unsigned long long i = st->base % SEQ_WINDOW;
+		unsigned char mask = 1 << (i & 7);
+
+		if (st->bits[i >> 3] & mask) {
+			st->bits[i >> 3] &= ~mask;
+			st->run = 0;
+			continue;
+		}
+		ss->lost++;
+		st->run++;
+		ss->gap_max = max(ss->gap_max, st->run);
+	}
+}
+
+
+/* account one data datagram, return true if its data is new */
+static bool seq_account(struct seq_track *st, struct seq_stat *ss,
+		unsigned long long seq)
+{
+	unsigned long long i = seq % SEQ_WINDOW;
+	unsigned char mask = 1 << (i & 7);
+
+	if (seq < st->base) {
+		ss->late++;
+		return true;
+	}
+
+	if (seq >= st->base + SEQ_WINDOW)
+		seq_retire(st, ss, seq - SEQ_WINDOW + 1);
+
+	if (st->bits[i >> 3] & mask) {
+		ss->dups++;
+		return false;
+	}
+	st->bits[i >> 3] |= mask;
+	ss->received++;
+
+	if (seq < st->next) {
+		ss->reordered++;
+		ss->reorder_max = max(ss->reorder_max, st->next - seq);
+	} else {
+		st->next = seq + 1;
+	}
+	return true;
+}
+
+
+/* interarrival jitter as in RFC 3550, 6.4.1 */
+static void seq_jitter(struct seq_track *st, struct seq_stat *ss,
+		const struct ns_seq *hdr, const struct timespec *now)
+{
+	uint32_t sec = ntohl(hdr->sec), nsec = ntohl(hdr->nsec);
+	double transit, d;
+
+	transit = ((double) now->tv_sec - sec) * 1e6 + ((double) now->tv_nsec - nsec) / 1e3;
+
+	if (ss->received + ss->dups + ss->late > 1) {
+		d = transit - st->last_transit;
+		if (d < 0)
+			d = -d;
+		ss->jitter_us += (d - ss->jitter_us) / 16;
+	}
+	st->last_transit = transit;
+}
+
+
+static bool seq_have(const struct seq_track *st, unsigned long long seq)
+{
+	return (seq >> 3) < st->have_len && (st->have[seq >> 3] & (1 << (seq & 7)));
+}
+
+
+static void seq_have_set(struct seq_track *st, unsigned long long seq)
+{
+	if ((seq >> 3) >= st->have_len) {
+		size_t len = max(2 * st->have_len, (size_t) (seq >> 3) + 1);
+
+		st->have = xrealloc(st->have, len);
+		memset(st->have + st->have_len, 0, len - st->have_len);
+		st->have_len = len;
+	}
+	st->have[seq >> 3] |= 1 << (seq & 7);
+}
+
+
+/* answer a poll of the transmitter with the missing datagrams
+** or - if nothing is missing - with an empty acknowledgement */
+static void nak_feedback(struct seq_track *st, struct net_stat *ns,
+		const struct sockaddr_storage *src, const struct ns_nak_poll *poll)
+{
+	struct sockaddr_storage to = *src;
+	unsigned long long seq = 0, start;
+	unsigned int n = 0;
+	struct ns_nak nak;
+
+	for (seq = 0; seq < st->end && n < NS_NAK_MAX_RANGES; n++) {
+		while (seq < st->end && seq_have(st, seq))
+			seq++;
+		if (seq == st->end)
+			break;
+
+		start = seq;
+		while (seq < st->end && !seq_have(st, seq) && seq - start < UINT32_MAX)
+			seq++;
+
+		nak.range[n].start_hi = htonl(start >> 32);
+		nak.range[n].start_lo = htonl(start & 0xffffffff);
+		nak.range[n].count = htonl(seq - start);
+	}
+
+	nak.magic = htons(NS_MAGIC);
+	nak.nranges = htons(n);
+	nak.round = poll->round;
+	nak.id = htonl(st->id);
+
+	if (to.ss_family == AF_INET6)
+		((struct sockaddr_in6 *) &to)->sin6_port = poll->port;
+	else
+		((struct sockaddr_in *) &to)->sin_port = poll->port;
+
+	if (st->fb_fd < 0) {
+		st->fb_fd = socket(to.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+		if (st->fb_fd < 0)
+			err_sys_die(EXIT_FAILNET, "socket");
+	}
+
+	if (sendto(st->fb_fd, &nak, offsetof(struct ns_nak, range) + n * sizeof(nak.range[0]), 0,
+			(struct sockaddr *) &to, sizeof(to)) < 0) {
+		err_sys("Could not send NAK");
+		return;
+	}
+
+	if (n)
+		ns->nak.naks++;
+	msg(STRESSFUL, "round %u: %s", ntohl(poll->round), n ? "NAK sent" : "complete");
+}
+
+
+static int seq_write(struct seq_track *st, unsigned long long seq, size_t seg,
+		const unsigned char *data, size_t len)
+{
+	ssize_t ret;
+
+	if (st->nak)
+		seq_have_set(st, seq);
+
+	do {
+		if (st->regular)
+			ret = pwrite(st->file_fd, data, len, (off_t) (seq * seg));
+		else
+			ret = write(st->file_fd, data, len);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret != (ssize_t) len) {
+		err_sys("write failed");
+		st->write_failed = true;
+		return -1;
+	}
+	st->ns->total_rx_bytes += len;
+	return 0;
+}
+
+
+/* fec rebuilt a lost datagram */
+static void seq_fec_deliver(void *ctx, unsigned long long seq,
+		const unsigned char *data, size_t len)
+{
+	struct seq_track *st = ctx;
+
+	if (st->write_failed || (st->nak && seq_have(st, seq)))
+		return;
+	seq_write(st, seq, st->fec.seg, data, len);
+}
+
+
+static void seq_fec_setup(struct seq_track *st, const struct ns_fec *fec, size_t seg)
+{
+	struct fec_code code = { .type = fec->type, .n = fec->n, .k = fec->k };
+
+	if ((code.type != FEC_XOR && code.type != FEC_RS) || code.n == 0 ||
+			code.n > FEC_MAX_N || code.k == 0 || code.k > FEC_MAX_K || seg == 0) {
+		err_msg("ignore invalid fec code %u (%u+%u)", fec->type, fec->n, fec->k);
+		return;
+	}
+	fec_rx_init(&st->fec, &code, seg, seq_fec_deliver, st);
+	st->fec_ready = true;
+}
+
+
+/* process one datagram, return -1 if the data can't be written */
+static int seq_datagram(struct seq_track *st, struct net_stat *ns,
+		const unsigned char *dgram, size_t len,
+		const struct sockaddr_storage *src, const struct timespec *now)
+{
+	struct seq_stat *ss = &ns->seq;
+	struct ns_seq hdr;
+	unsigned long long seq;
+	uint16_t flags;
+	size_t payload;
+	bool fresh;
+
+	if (len < sizeof(hdr))
+		return 0;
+
+	memcpy(&hdr, dgram, sizeof(hdr));
+	seq = ((unsigned long long) ntohl(hdr.seq_hi) << 32) | ntohl(hdr.seq_lo);
+	flags = ntohs(hdr.flags);
+	payload = len - sizeof(hdr);
+
+	if (flags & NS_SEQ_END) {
+		if (!ss->end_seen)
+			msg(LOUDISH, "end marker after %llu datagrams", seq);
+		ss->end_seen = true;
+		st->end = seq;
+		return 0;
+	}
+
+	if (flags & NS_SEQ_POLL) {
+		struct ns_nak_poll poll;
+
+		if (!st->nak || payload < sizeof(poll))
+			return 0;
+		memcpy(&poll, dgram + sizeof(hdr), sizeof(poll));
+
+		/* a poll is sent several times, one answer per round */
+		st->end = seq;
+		if (ntohl(poll.round) == st->round)
+			return 0;
+		st->round = ntohl(poll.round);
+		ns->nak.rounds++;
+		nak_feedback(st, ns, src, &poll);
+		return 0;
+	}
+
+	if (flags & (NS_SEQ_FEC | NS_SEQ_PARITY)) {
+		struct ns_fec fec;
+
+		if (payload < sizeof(fec))
+			return 0;
+		memcpy(&fec, dgram + sizeof(hdr), sizeof(fec));
+
+		/* the parity repeats the code in case the announcement got lost */
+		if (!st->fec_ready)
+			seq_fec_setup(st, &fec, ntohs(hdr.seg));
+		if (!st->fec_ready || !(flags & NS_SEQ_PARITY))
+			return 0;
+
+		fec_rx_parity(&st->fec, seq, fec.index, ntohs(fec.count), ntohs(fec.tail_len),
+				dgram + sizeof(hdr) + sizeof(fec), payload - sizeof(fec));
+		return st->write_failed ? -1 : 0;
+	}
+
+	if (flags & NS_SEQ_REPAIR) {
+		if (!st->nak)
+			return 0;
+		if (seq_have(st, seq)) {
+			ns->nak.repair_dups++;
+			return 0;
+		}
+		ns->nak.repairs++;
+		fresh = true;
+	} else {
+		/* the first transmission makes up the loss statistic */
+		ns->total_rx_msgs++;
+		seq_jitter(st, ss, &hdr, now);
+		fresh = seq_account(st, ss, seq);
+		if (st->nak)
+			fresh = !seq_have(st, seq);
+	}
+
+	/* the block copy may rebuild other datagrams, a rebuilt one is
+	 * known already */
+	if (st->fec_ready && !fec_rx_data(&st->fec, seq, dgram + sizeof(hdr), payload))
+		fresh = false;
+	if (st->write_failed)
+		return -1;
+
+	if (!fresh)
+		return 0;
+	return seq_write(st, seq, ntohs(hdr.seg), dgram + sizeof(hdr), payload);
+}
+
+
+static ssize_t
+cs_read_seq(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns)
+{
+	unsigned int i, batch = opts.mmsg_batch ? opts.mmsg_batch : 16;
+	const size_t ctrllen = CMSG_SPACE(sizeof(int));
+	struct seq_stat *ss = &ns->seq;
+	struct sockaddr_storage *src;
+	struct seq_track st;
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	struct pollfd pfd;
+	struct stat sb;
+	char *buf, *ctrl;
+	bool timed_out = false;
+	int rc = 0, idle = SEQ_IDLE_TIMEOUT;
+
+	if (fstat(file_fd, &sb) < 0)
+		err_sys_die(EXIT_FAILMISC, "Can't stat output file");
+
+	memset(&st, 0, sizeof(st));
+	st.bits = xzalloc(SEQ_WINDOW / 8);
+	st.file_fd = file_fd;
+	st.regular = S_ISREG(sb.st_mode);
+	st.nak = phi->nak;
+	st.fb_fd = -1;
+	st.ns = ns;
+	ss->enabled = true;
+
+	msg(GENTLE, "peer sends sequenced datagrams, %s", st.regular ?
+			"data is placed at its file offset" : "data is written in arrival order");
+
+	if (st.nak) {
+		if (!st.regular)
+			err_msg_die(EXIT_FAILOPT, "reliable multicast requires a regular output file");
+
+		/* tells receivers behind one address apart */
+		srandom(getpid() ^ time(NULL));
+		st.id = random();
+		msg(GENTLE, "peer repairs lost datagrams on request (receiver id %08x)", st.id);
+	}
+
+	buf  = xmalloc(batch * SEQ_SLOT);
+	iov  = xmalloc(batch * sizeof(*iov));
+	msgs = xzalloc(batch * sizeof(*msgs));
+	ctrl = xzalloc(batch * ctrllen);
+	src  = xmalloc(batch * sizeof(*src));
+
+	for (i = 0; i < batch; i++) {
+		iov[i].iov_base = buf + i * SEQ_SLOT;
+		iov[i].iov_len = SEQ_SLOT;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &src[i];
+	}
+
+	pfd.fd = connected_fd;
+	pfd.events = POLLIN;
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	for (;;) {
+		struct timespec now;
+
+		/* all data up to the end marker is in - with repairs the
+		 * transmitter sends the end marker after the last round,
+		 * with fec after the last parity */
+		if (ss->end_seen && (st.nak || st.fec_ready ||
+				(ss->lost == 0 && ss->received >= st.end)))
+			break;
+
+		idle = ss->end_seen ? SEQ_END_GRACE : SEQ_IDLE_TIMEOUT;
+		rc = poll(&pfd, 1, idle);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0) {
+			err_sys("poll failed");
+			break;
+		}
+		if (rc == 0) {
+			if (!ss->end_seen)
+				msg(GENTLE, "no datagram for %d ms, assuming the transfer is over",
+						SEQ_IDLE_TIMEOUT);
+			timed_out = true;
+			break;
+		}
+
+		for (i = 0; i < batch; i++) {
+			msgs[i].msg_hdr.msg_control = ctrl + i * ctrllen;
+			msgs[i].msg_hdr.msg_controllen = ctrllen;
+			msgs[i].msg_hdr.msg_namelen = sizeof(*src);
+		}
+
+		rc = recvmmsg(connected_fd, msgs, batch, MSG_DONTWAIT, NULL);
+		if (rc < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (rc < 0) {
+			err_sys("recvmmsg failed");
+			break;
+		}
+
+		ns->total_rx_calls++;
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		for (i = 0; i < (unsigned int) rc; i++) {
+			unsigned char *dgram = iov[i].iov_base;
+			unsigned int len = msgs[i].msg_len;
+			unsigned int seg = gro_seg_size(&msgs[i].msg_hdr, len);
+			unsigned int off;
+
+			/* with UDP GRO one read carries several datagrams */
+			for (off = 0; off < len; off += seg) {
+				if (seq_datagram(&st, ns, dgram + off,
+						min(seg, len - off), &src[i], &now) < 0) {
+					rc = -1;
+					goto out;
+				}
+			}
+		}
+	}
+
+out:
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	/* the idle wait is not part of the transfer */
+	if (timed_out) {
+		struct timeval tv_idle = { idle / 1000, (idle % 1000) * 1000 };
+		timersub(&ns->use_stat_end.time, &tv_idle, &ns->use_stat_end.time);
+	}
+
+	/* the end marker tells how many datagrams were sent */
+	ss->expected = ss->end_seen || st.round ? st.end : st.next;
+	seq_retire(&st, ss, max(ss->expected, st.base));
+
+	if (st.fec_ready) {
+		fec_rx_finish(&st.fec, ss->expected);
+		ns->fec.parity = st.fec.parity;
+		ns->fec.recovered = st.fec.recovered;
+		ns->fec.unrecoverable = st.fec.unrecoverable;
+		fec_rx_free(&st.fec);
+	}
+
+	free(src);
+	free(ctrl);
+	free(msgs);
+	free(iov);
+	free(buf);
+	if (st.fb_fd >= 0)
+		close(st.fb_fd);
+	free(st.have);
+	free(st.bits);
+	return rc < 0 ? -1 : 0;
+}
+
+
+/* nanoseconds since start */
+static unsigned long long
+ns_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000000LL +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+
+/* Incremental writeback (--sync WINDOW): as soon as the receive
+** cursor leaves a window of the output file, its write-out is
+** started and the window before is waited for. The dirty backlog
+** stays below two windows instead of growing with the file, the
+** final fsync is left with the last ones and the storage sets the
+** pace of the transfer, so the statistic shows the durable rate and
+** not the one of the page cache.
+*/
+struct rx_sync {
+	int fd;
+	off_t window;  /* < 0: off */
+	off_t start;   /* < start of the window being written */
+	off_t pending; /* < start of the window in write-out, -1: none */
+};
+
+
+static void
+rx_sync_init(struct rx_sync *rs, int fd, off_t offset)
+{
+	rs->fd = fd;
+	rs->window = opts.sync_window;
+	rs->start = offset;
+	rs->pending = -1;
+}
+
+
+/* the file is written up to end */
+static void
+rx_sync_advance(struct rx_sync *rs, off_t end, struct net_stat *ns)
+{
+#ifdef HAVE_SYNC_FILE_RANGE
+	struct timespec start;
+
+	if (!rs->window || end - rs->start < rs->window)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (end - rs->start >= rs->window) {
+		if (sync_file_range(rs->fd, rs->start, rs->window, SYNC_FILE_RANGE_WRITE)) {
+			msg(GENTLE, "can't write back the output file incrementally: %s",
+					strerror(errno));
+			rs->window = 0;
+			break;
+		}
+		if (rs->pending >= 0 && sync_file_range(rs->fd, rs->pending, rs->window,
+					SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+					SYNC_FILE_RANGE_WAIT_AFTER))
+			err_sys("Failure in sync_file_range");
+
+		rs->pending = rs->start;
+		rs->start += rs->window;
+		ns->sync_windows++;
+	}
+	ns->writeback_ns += ns_since(&start);
+#else
+	(void) rs; (void) end; (void) ns;
+#endif
+}
+
+
+#ifdef HAVE_SPLICE
+/* move one splice worth of data from the pipe to the file */
+static ssize_t splice_topfile(int pipe_fd, int file_fd, loff_t *off_out,
+		size_t len, struct net_stat *ns)
+{
+	ssize_t written, total = 0;
+
+	while (len > 0) {
+		written = splice(pipe_fd, NULL, file_fd, off_out, len, SPLICE_F_MOVE);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			err_sys("Failure in splice to file");
+			return -1;
+		}
+		ns->splice_calls++;
+		total += written;
+		len -= written;
+	}
+	return total;
+}
+#endif
+
+
+/* Zero copy receive (-u splice): socket -> pipe -> file, the
+** data moves as page references and never enters user space.
+** A fifo as output (e.g. stdout into a pipe) takes the data
+** straight from the socket. total_rx_calls counts the splices
+** from the socket, splice_calls both directions.
+*/
+static ssize_t
+cs_read_splice(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns)
+{
+#ifdef HAVE_SPLICE
+	int pipefds[2], pipe_in;
+	struct stat stat_buf;
+	loff_t offset = phi->stream_offset, *off_out = NULL;
+	struct rx_sync rsync;
+	size_t chunk, want;
+	ssize_t rc;
+	bool direct;
+
+	msg(STRESSFUL, "receive via splice io operation");
+
+	xfstat(file_fd, &stat_buf, opts.outfile ? opts.outfile : "stdout");
+	direct = S_ISFIFO(stat_buf.st_mode);
+	if (direct) {
+		pipe_in = file_fd;
+	} else {
+		xpipe(pipefds);
+		pipe_in = pipefds[1];
+	}
+	ns->pipe_size = grow_pipe(pipe_in);
+
+	/* parallel streams write at the stream offset */
+	if (phi->stream_count > 1)
+		off_out = &offset;
+
+	chunk = ns->pipe_size;
+	if (opts.buffer_size > 0 && (unsigned int) opts.buffer_size < ns->pipe_size)
+		chunk = opts.buffer_size;
+
+	rx_sync_init(&rsync, file_fd, phi->stream_offset);
+	if (direct)
+		rsync.window = 0;
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	for (;;) {
+		want = chunk;
+
+		/* datagram protocols don't signal the end of the data */
+		if (phi->data_size != 0) {
+			if (ns->total_rx_bytes >= phi->data_size)
+				break;
+			want = min(want, (size_t) (phi->data_size - ns->total_rx_bytes));
+		}
+
+		rc = splice(connected_fd, NULL, pipe_in, NULL, want,
+				SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			err_sys("Failure in splice from socket");
+			break;
+		}
+		if (rc == 0)
+			break;
+
+		ns->total_rx_calls++;
+		ns->splice_calls++;
+		ns->total_rx_bytes += rc;
+
+		if (!direct && splice_topfile(pipefds[0], file_fd, off_out, rc, ns) != rc) {
+			rc = -1;
+			break;
+		}
+		rx_sync_advance(&rsync, phi->stream_offset + ns->total_rx_bytes, ns);
+
+		if (opts.delay_read) {
+			msg(LOUDISH, "delay splice() operation for %d seconds", opts.delay_read);
+			sleep(opts.delay_read);
+		}
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	if (!direct) {
+		close(pipefds[0]);
+		close(pipefds[1]);
+	}
+	return rc;
+#else
+	(void) file_fd; (void) connected_fd; (void) phi; (void) ns;
+	err_msg_die(EXIT_FAILMISC, "splice support not compiled in");
+#endif
+}
+
+
+/* account the time since start to the file writes */
+static void
+write_time_account(struct net_stat *ns, const struct timespec *start)
+{
+	ns->write_ns += ns_since(start);
+}
+
+
+/* The plain receive loop: read() a buffer, write() it */
+static ssize_t
+cs_read_rw(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns, int buflen)
+{
+	ssize_t rc;
+	char *buf;
+	off_t offset = phi->stream_offset;
+	struct rx_sync rsync;
+
+	buf = xmalloc(buflen);
+	rx_sync_init(&rsync, file_fd, offset);
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	/* main client loop */
+	while ((rc = read(connected_fd, buf, buflen)) > 0) {
+		struct timespec start;
+		ssize_t ret;
+		ns->total_rx_calls++;
+		ns->total_rx_bytes += rc;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			if (phi->stream_count > 1)
+				ret = pwrite(file_fd, buf, rc, offset);
+			else
+				ret = write(file_fd, buf, rc);
+		} while (ret == -1 && errno == EINTR);
+		write_time_account(ns, &start);
+
+		if (ret != rc) {
+			err_sys("write failed");
+			break;
+		}
+		offset += rc;
+		rx_sync_advance(&rsync, offset, ns);
+
+		if (ns->total_rx_bytes >= phi->data_size && phi->data_size != 0) {
+
+			/* we are at the end of the
+			 * announced data amount. Protocols like
+			 * TCP indicate the end of the data stream.
+			 * Datagramm based protocols like UDP or
+			 * UDPLite not. So we break here if we received
+			 * the former announced amount of data */
+			break;
+		}
+
+		if (opts.delay_read) {
+			msg(LOUDISH, "delay read() operation for %d seconds", opts.delay_read);
+			sleep(opts.delay_read);
+		}
+
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+	free(buf);
+	return rc;
+}
+
+
+#ifdef HAVE_TCP_ZEROCOPY_RECEIVE
+/* write the received data at the offset, a single stream appends */
+static bool
+rx_zc_write(int file_fd, const char *data, size_t len, off_t *offset,
+		struct peer_header_info *phi, struct net_stat *ns)
+{
+	struct timespec start;
+	ssize_t ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		if (phi->stream_count > 1)
+			ret = pwrite(file_fd, data, len, *offset);
+		else
+			ret = write(file_fd, data, len);
+	} while (ret == -1 && errno == EINTR);
+	write_time_account(ns, &start);
+
+	if (ret != (ssize_t) len) {
+		err_sys("write failed");
+		return false;
+	}
+	*offset += len;
+	return true;
+}
+#endif
+
+
+/* Zero copy TCP receive (-u rw:zc): the payload pages are mapped
+** from the socket into a region of the process with getsockopt
+** TCP_ZEROCOPY_RECEIVE instead of being copied. Only whole pages
+** can be mapped, what the kernel can't map (data which doesn't sit
+** page aligned in the skb, the tail of the stream) is read into a
+** buffer as usual - recv_skip_hint tells how much. The next call
+** replaces the pages of the region, so the data is written out
+** before. SO_RCVLOWAT lets poll wake up for a full region only.
+*/
+static ssize_t
+cs_read_tcp_zc(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns, int buflen)
+{
+#ifdef HAVE_TCP_ZEROCOPY_RECEIVE
+	size_t page_size = sysconf(_SC_PAGESIZE), region;
+	struct tcp_zerocopy_receive zc;
+	off_t offset = phi->stream_offset;
+	struct rx_sync rsync;
+	socklen_t zc_len;
+	ssize_t rc = 0;
+	char *addr, *buf;
+	int lowat;
+
+	region = max((size_t) DEFAULT_ZC_RX_REGION, (size_t) buflen);
+	region = (region + page_size - 1) & ~(page_size - 1);
+
+	addr = mmap(NULL, region, PROT_READ, MAP_SHARED, connected_fd, 0);
+	if (addr == MAP_FAILED) {
+		msg(GENTLE, "can't map the socket (%s), fall back to read/write",
+				strerror(errno));
+		return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
+	}
+
+	lowat = region;
+	if (setsockopt(connected_fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat)))
+		msg(LOUDISH, "can't set SO_RCVLOWAT: %s", strerror(errno));
+
+	msg(STRESSFUL, "receive via TCP_ZEROCOPY_RECEIVE into a %zu byte region", region);
+
+	/* the copied part is read in pieces of up to a region */
+	buf = xmalloc(region);
+	rx_sync_init(&rsync, file_fd, offset);
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	for (;;) {
+		struct pollfd pfd = { .fd = connected_fd, .events = POLLIN };
+
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			err_sys("Failure in poll");
+			rc = -1;
+			break;
+		}
+
+		memset(&zc, 0, sizeof(zc));
+		zc.address = (uintptr_t) addr;
+		zc.length = region;
+		zc_len = sizeof(zc);
+
+		if (getsockopt(connected_fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &zc, &zc_len)) {
+			if (errno == EINTR)
+				continue;
+			/* the peer closed and everything is consumed */
+			if (errno == EIO) {
+				rc = 0;
+				break;
+			}
+			if (ns->total_rx_bytes == 0 && (errno == EOPNOTSUPP ||
+						errno == EINVAL || errno == ENOPROTOOPT)) {
+				msg(GENTLE, "kernel doesn't support TCP_ZEROCOPY_RECEIVE, "
+						"fall back to read/write");
+				munmap(addr, region);
+				free(buf);
+				return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
+			}
+			err_sys("Failure in getsockopt TCP_ZEROCOPY_RECEIVE");
+			rc = -1;
+			break;
+		}
+		ns->total_rx_calls++;
+
+		if (zc.length) {
+			ns->total_rx_bytes += zc.length;
+			ns->zc_rx_mapped += zc.length;
+			if (!rx_zc_write(file_fd, addr, zc.length, &offset, phi, ns)) {
+				rc = -1;
+				break;
+			}
+		}
+
+		/* the bytes behind the mapped ones which need a copy */
+		if (zc.recv_skip_hint) {
+			do {
+				rc = read(connected_fd, buf, min((size_t) zc.recv_skip_hint, region));
+			} while (rc == -1 && errno == EINTR);
+
+			if (rc <= 0) {
+				if (rc < 0)
+					err_sys("read failed");
+				break;
+			}
+			ns->total_rx_bytes += rc;
+			ns->zc_rx_copied += rc;
+			if (!rx_zc_write(file_fd, buf, rc, &offset, phi, ns)) {
+				rc = -1;
+				break;
+			}
+		}
+		rx_sync_advance(&rsync, offset, ns);
+
+		if (ns->total_rx_bytes >= phi->data_size && phi->data_size != 0)
+			break;
+
+		if (opts.delay_read) {
+			msg(LOUDISH, "delay read() operation for %d seconds", opts.delay_read);
+			sleep(opts.delay_read);
+		}
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	munmap(addr, region);
+	free(buf);
+	return rc;
+#else
+	(void) file_fd; (void) connected_fd; (void) phi; (void) ns; (void) buflen;
+	err_msg_die(EXIT_FAILMISC, "TCP_ZEROCOPY_RECEIVE support not compiled in");
+#endif
+}
+
+
+#ifndef RWF_DONTCACHE
+# define RWF_DONTCACHE 0x00000080 /* linux 6.14 */
+#endif
+
+/* write len bytes at offset, with RWF_DONTCACHE as long as the
+** kernel accepts it. Return false on failure */
+static bool
+uncached_write(int fd, const char *buf, size_t len, off_t offset,
+		bool *dontcache, struct net_stat *ns)
+{
+	struct iovec iov = { .iov_base = (void *) buf, .iov_len = len };
+	struct timespec start;
+	ssize_t ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		if (*dontcache) {
+			ret = pwritev2(fd, &iov, 1, offset, RWF_DONTCACHE);
+			if (ret == -1 && (errno == EOPNOTSUPP || errno == EINVAL)) {
+				msg(GENTLE, "kernel or file system doesn't support RWF_DONTCACHE, "
+						"use the page cache");
+				*dontcache = false;
+				errno = EINTR;
+			}
+		} else {
+			ret = pwrite(fd, buf, len, offset);
+		}
+	} while (ret == -1 && errno == EINTR);
+	write_time_account(ns, &start);
+
+	if (ret != (ssize_t) len) {
+		err_sys("write failed");
+		return false;
+	}
+	return true;
+}
+
+
+/* Cache bypassing receive (-u rw:direct respective rw:dontcache):
+** the socket fills an aligned staging buffer, every full buffer is
+** written at its file offset - with O_DIRECT, or with
+** RWF_DONTCACHE, which drops the pages as soon as they are written
+** back. So the data doesn't push other data out of the page cache
+** and the final fsync has little left to do. O_DIRECT writes the
+** unaligned tail as a whole block and cuts the file to its size
+** afterwards. Parallel stream slices are page aligned, only the last
+** stream has such a tail. A datagram is read as a whole into a
+** bounce buffer - a read into the rest of the staging buffer would
+** cut it off - and may straddle two staging buffers.
+*/
+static ssize_t
+cs_read_uncached(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns, int buflen)
+{
+	bool direct = opts.io_flags & IOF_DIRECT;
+	bool dontcache = opts.io_flags & IOF_DONTCACHE;
+	off_t offset = phi->stream_offset;
+	size_t len = buflen, fill = 0;
+	struct rx_sync rsync;
+	struct stat stat_buf;
+	ssize_t rc;
+	char *buf, *dgram = NULL;
+
+	xfstat(file_fd, &stat_buf, opts.outfile ? opts.outfile : "stdout");
+	if (!S_ISREG(stat_buf.st_mode)) {
+		msg(GENTLE, "uncached receive needs a regular output file, fall back to read/write");
+		return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
+	}
+
+	msg(STRESSFUL, "receive via %s writes of %d byte",
+			direct ? "O_DIRECT" : "RWF_DONTCACHE", buflen);
+
+	if (direct)
+		len = DIRECT_ALIGN_UP(len);
+	buf = xmemalign(DIRECT_IO_ALIGN, len);
+	if (opts.socktype == SOCK_DGRAM)
+		dgram = xmalloc(buflen);
+	rx_sync_init(&rsync, file_fd, offset);
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	for (;;) {
+		const char *src = dgram;
+		size_t left;
+
+		do {
+			if (dgram)
+				rc = read(connected_fd, dgram, buflen);
+			else
+				rc = read(connected_fd, buf + fill, len - fill);
+		} while (rc == -1 && errno == EINTR);
+
+		if (rc <= 0) {
+			if (rc < 0)
+				err_sys("read failed");
+			break;
+		}
+
+		ns->total_rx_calls++;
+		ns->total_rx_bytes += rc;
+		if (dgram) {
+			left = rc;
+		} else {
+			fill += rc;
+			left = 0;
+		}
+
+		do {
+			if (left) {
+				size_t n = min(left, len - fill);
+
+				memcpy(buf + fill, src, n);
+				fill += n;
+				src += n;
+				left -= n;
+			}
+			if (fill == len) {
+				if (!uncached_write(file_fd, buf, len, offset, &dontcache, ns)) {
+					rc = -1;
+					break;
+				}
+				offset += len;
+				fill = 0;
+				rx_sync_advance(&rsync, offset, ns);
+			}
+		} while (left);
+		if (rc < 0)
+			break;
+
+		/* datagram protocols don't signal the end of the data */
+		if (ns->total_rx_bytes >= phi->data_size && phi->data_size != 0)
+			break;
+
+		if (opts.delay_read) {
+			msg(LOUDISH, "delay read() operation for %d seconds", opts.delay_read);
+			sleep(opts.delay_read);
+		}
+	}
+
+	if (fill && rc >= 0) {
+		size_t wlen = direct ? DIRECT_ALIGN_UP(fill) : fill;
+
+		memset(buf + fill, 0, wlen - fill);
+		if (!uncached_write(file_fd, buf, wlen, offset, &dontcache, ns))
+			rc = -1;
+		else if (wlen != fill && ftruncate(file_fd, offset + fill))
+			err_sys("Can't truncate the output file");
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+	free(dgram);
+	free(buf);
+
+	return rc;
+}
+
+
+/* Pipelined receive (-u rw:pipeline): the socket reader fills a
+** ring of opts.io_depth buffers and a writer thread drains it to
+** the file. A slow write no longer stops the reads, so the socket
+** receive queue is drained and the TCP window stays open while the
+** storage catches up. The handoff is the one of the pipelined
+** transmitter, with the roles of the stall counters swapped.
+*/
+struct rx_ring {
+	uint32_t head;   /* < buffers received, written by the reader */
+	uint32_t tail;   /* < buffers written, written by the writer */
+	uint32_t head_waiter;
+	uint32_t tail_waiter;
+	uint32_t failed; /* < the writer failed, the reader stops */
+	unsigned int nbuf;
+	size_t buflen;
+	char *buf;
+	ssize_t *len;    /* < bytes in buffer, 0: end of data */
+	int file_fd;
+	bool positional; /* < parallel streams write at the stream offset */
+	off_t offset;
+	struct rx_sync sync;
+	struct net_stat *ns;
+};
+
+
+static void *rx_writer_main(void *arg)
+{
+	struct rx_ring *ring = arg;
+	uint32_t tail = 0;
+	ssize_t cnt, ret;
+
+	for (;;) {
+		unsigned int idx = tail % ring->nbuf;
+		char *buf = ring->buf + idx * ring->buflen;
+
+		/* ring empty - wait for the socket reader */
+		if (ring_wait(&ring->head, tail, &ring->head_waiter))
+			ring->ns->ring_empty_stalls++;
+
+		cnt = ring->len[idx];
+		if (cnt == 0)
+			break;
+
+		/* after a failure the ring is drained until the end marker */
+		if (!ring->failed) {
+			do {
+				if (ring->positional)
+					ret = pwrite(ring->file_fd, buf, cnt, ring->offset);
+				else
+					ret = write(ring->file_fd, buf, cnt);
+			} while (ret == -1 && errno == EINTR);
+
+			if (ret != cnt) {
+				err_sys("write failed");
+				__atomic_store_n(&ring->failed, 1, __ATOMIC_RELEASE);
+			}
+			ring->offset += cnt;
+			rx_sync_advance(&ring->sync, ring->offset, ring->ns);
+		}
+
+		ring_publish(&ring->tail, ++tail, &ring->tail_waiter);
+	}
+
+	return NULL;
+}
+
+
+static ssize_t
+cs_read_pipeline(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns, int buflen)
+{
+	struct rx_ring ring;
+	pthread_t writer;
+	uint32_t head = 0;
+	ssize_t rc = 0, cnt;
+	bool done = false;
+	int ret;
+
+	msg(STRESSFUL, "receive via pipelined read/write io operation (%d buffers)",
+			opts.io_depth);
+
+	memset(&ring, 0, sizeof(ring));
+	ring.nbuf = opts.io_depth;
+	ring.buflen = buflen;
+	ring.buf = xmemalign(DIRECT_IO_ALIGN, ring.nbuf * ring.buflen);
+	ring.len = xmalloc(ring.nbuf * sizeof(*ring.len));
+	ring.file_fd = file_fd;
+	ring.positional = phi->stream_count > 1;
+	ring.offset = phi->stream_offset;
+	rx_sync_init(&ring.sync, file_fd, ring.offset);
+	ring.ns = ns;
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	ret = pthread_create(&writer, NULL, rx_writer_main, &ring);
+	if (ret)
+		err_msg_die(EXIT_FAILMISC, "Can't create writer thread: %s", strerror(ret));
+
+	do {
+		unsigned int idx = head % ring.nbuf;
+
+		/* ring full - wait until the writer releases the oldest buffer */
+		if (ring_wait(&ring.tail, head - ring.nbuf, &ring.tail_waiter) && !done)
+			ns->ring_full_stalls++;
+
+		cnt = 0;
+		if (!done && !__atomic_load_n(&ring.failed, __ATOMIC_ACQUIRE)) {
+			do {
+				rc = read(connected_fd, ring.buf + idx * ring.buflen, ring.buflen);
+			} while (rc == -1 && errno == EINTR);
+
+			if (rc < 0)
+				err_sys("read failed");
+			if (rc > 0) {
+				cnt = rc;
+				ns->total_rx_calls++;
+				ns->total_rx_bytes += rc;
+
+				/* datagram protocols don't signal the end of the data */
+				done = ns->total_rx_bytes >= phi->data_size && phi->data_size != 0;
+			}
+		}
+
+		ring.len[idx] = cnt;
+		ring_publish(&ring.head, ++head, &ring.head_waiter);
+
+		if (cnt > 0 && opts.delay_read) {
+			msg(LOUDISH, "delay read() operation for %d seconds", opts.delay_read);
+			sleep(opts.delay_read);
+		}
+	} while (cnt > 0);
+
+	pthread_join(writer, NULL);
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	free(ring.len);
+	free(ring.buf);
+
+	return ring.failed ? -1 : rc;
+}
+
+
+#ifdef HAVE_IO_URING
+/* io_uring receive (-u uring): one multishot recv fills the
+** buffers of a provided buffer ring, every completion becomes a
+** write of that buffer at the next file offset. The buffer goes
+** back to the ring when its write completed - so up to depth
+** buffers are received respective written at the same time.
+*/
+
+#define	URING_RX_BGID 0
+#define	URING_OP_RECV 1
+#define	URING_OP_WRITE 2
+
+struct uring_rx_buf {
+	off_t offset;
+	size_t len;
+	size_t written;
+};
+
+struct uring_rx {
+	struct uring ring;
+	struct uring_buf_ring br;
+	struct uring_rx_buf *buf;
+	char *pool;
+	size_t buflen;
+	unsigned int depth;
+	bool fixed_files;
+	bool fixed_bufs;
+	int file_fd; /* < fd or index into the registered files */
+	int connected_fd;
+	off_t offset;          /* < file offset of the next received byte */
+	bool armed;            /* < the multishot recv is active */
+	bool done;             /* < end of data, no further recv */
+	unsigned int writes;   /* < writes in flight, one per buffer */
+	unsigned long long data_size;
+	struct net_stat *ns;
+};
+
+
+static struct io_uring_sqe *uring_rx_sqe(struct uring_rx *rx, int fd, unsigned int op,
+		unsigned int idx)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&rx->ring);
+
+	if (!sqe)
+		err_msg_die(EXIT_FAILINT, "io_uring submission queue overflow");
+
+	sqe->fd = fd;
+	if (rx->fixed_files)
+		sqe->flags |= IOSQE_FIXED_FILE;
+	sqe->user_data = ((__u64) op << 32) | idx;
+
+	return sqe;
+}
+
+
+static void uring_rx_prep_recv(struct uring_rx *rx)
+{
+	struct io_uring_sqe *sqe = uring_rx_sqe(rx, rx->connected_fd, URING_OP_RECV, 0);
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_RX_BGID;
+
+	rx->armed = true;
+}
+
+
+static void uring_rx_prep_write(struct uring_rx *rx, unsigned int bid)
+{
+	struct uring_rx_buf *b = &rx->buf[bid];
+	struct io_uring_sqe *sqe = uring_rx_sqe(rx, rx->file_fd, URING_OP_WRITE, bid);
+
+	sqe->opcode = rx->fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->off = b->offset + b->written;
+	sqe->addr = (unsigned long) (rx->pool + bid * rx->buflen + b->written);
+	sqe->len = b->len - b->written;
+	sqe->buf_index = bid;
+}
+
+
+static void uring_rx_recycle(struct uring_rx *rx, unsigned int bid)
+{
+	uring_buf_ring_add(&rx->br, rx->pool + bid * rx->buflen, rx->buflen, bid);
+}
+
+
+static void uring_rx_complete(struct uring_rx *rx, const struct io_uring_cqe *cqe)
+{
+	unsigned int op = cqe->user_data >> 32, bid;
+	struct uring_rx_buf *b;
+
+	switch (op) {
+	case URING_OP_RECV:
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+			rx->armed = false;
+		if (cqe->res == -ENOBUFS) {
+			/* all buffers wait for their write, rearmed after one completed */
+			rx->ns->uring_nobufs++;
+			break;
+		}
+		if (cqe->res < 0) {
+			errno = -cqe->res;
+			err_sys_die(EXIT_FAILNET, "Failure in io_uring recv");
+		}
+		if (cqe->res == 0) {
+			rx->done = true;
+			break;
+		}
+
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		if (rx->done) {
+			/* beyond the announced data amount */
+			uring_rx_recycle(rx, bid);
+			break;
+		}
+
+		b = &rx->buf[bid];
+		b->offset = rx->offset;
+		b->len = cqe->res;
+		b->written = 0;
+		uring_rx_prep_write(rx, bid);
+		rx->writes++;
+
+		rx->offset += cqe->res;
+		rx->ns->total_rx_bytes += cqe->res;
+		rx->ns->uring_recvs++;
+
+		/* datagram protocols don't signal the end of the data */
+		if (rx->data_size && rx->ns->total_rx_bytes >= rx->data_size)
+			rx->done = true;
+		break;
+	case URING_OP_WRITE:
+		bid = cqe->user_data & 0xffffffff;
+		b = &rx->buf[bid];
+		if (cqe->res <= 0) {
+			errno = cqe->res ? -cqe->res : EIO;
+			err_sys_die(EXIT_FAILMISC, "Can't write %s",
+					opts.outfile ? opts.outfile : "stdout");
+		}
+		b->written += cqe->res;
+		if (b->written < b->len) {
+			uring_rx_prep_write(rx, bid);
+			break;
+		}
+		rx->writes--;
+		uring_rx_recycle(rx, bid);
+		break;
+	default:
+		err_msg_die(EXIT_FAILINT, "Programmed Failure");
+	}
+}
+#endif /* HAVE_IO_URING */
+
+
+static ssize_t
+cs_read_uring(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns, int buflen)
+{
+#ifdef HAVE_IO_URING
+	struct uring_rx rx;
+	struct io_uring_cqe *cqe;
+	struct stat stat_buf;
+	struct iovec *iov;
+	unsigned int i;
+	int fds[2];
+
+	msg(STRESSFUL, "receive via io_uring io operation");
+
+	xfstat(file_fd, &stat_buf, opts.outfile ? opts.outfile : "stdout");
+	if (!S_ISREG(stat_buf.st_mode)) {
+		msg(GENTLE, "io_uring requires a regular output file - fall back to read/write");
+		return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
+	}
+
+	memset(&rx, 0, sizeof(rx));
+	rx.buflen = buflen;
+	rx.data_size = phi->data_size;
+	rx.ns = ns;
+
+	/* parallel streams write at the stream offset */
+	if (phi->stream_count > 1)
+		rx.offset = phi->stream_offset;
+	else if ((rx.offset = lseek(file_fd, 0, SEEK_CUR)) < 0)
+		rx.offset = 0;
+
+	/* the buffer ring size is a power of two */
+	for (rx.depth = 1; rx.depth < (unsigned int) opts.io_depth; rx.depth <<= 1)
+		;
+
+	/* the recv and one write per buffer */
+	if (uring_init(&rx.ring, rx.depth * 2,
+				opts.io_flags & IOF_SQPOLL ? IORING_SETUP_SQPOLL : 0) < 0)
+		err_sys_die(EXIT_FAILMISC, "Can't setup io_uring");
+
+	if (uring_buf_ring_init(&rx.ring, &rx.br, rx.depth, URING_RX_BGID) < 0) {
+		msg(GENTLE, "no io_uring provided buffers (%s) - fall back to read/write",
+				strerror(errno));
+		uring_exit(&rx.ring);
+		return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
+	}
+
+	rx.pool = xmemalign(DIRECT_IO_ALIGN, rx.depth * rx.buflen);
+	rx.buf = xzalloc(rx.depth * sizeof(*rx.buf));
+	iov = xmalloc(rx.depth * sizeof(*iov));
+	for (i = 0; i < rx.depth; i++) {
+		iov[i].iov_base = rx.pool + i * rx.buflen;
+		iov[i].iov_len = rx.buflen;
+		uring_rx_recycle(&rx, i);
+	}
+
+	/* the provided buffers are registered as well, for the writes */
+	rx.fixed_bufs = uring_register_buffers(&rx.ring, iov, rx.depth) == 0;
+	if (!rx.fixed_bufs)
+		msg(LOUDISH, "can't register io_uring buffers: %s", strerror(errno));
+
+	fds[0] = file_fd;
+	fds[1] = connected_fd;
+	rx.fixed_files = uring_register_files(&rx.ring, fds, 2) == 0;
+	if (rx.fixed_files) {
+		rx.file_fd = 0;
+		rx.connected_fd = 1;
+	} else {
+		msg(LOUDISH, "can't register io_uring files: %s", strerror(errno));
+		rx.file_fd = file_fd;
+		rx.connected_fd = connected_fd;
+	}
+
+	msg(LOUDISH, "io_uring receive: depth %u, buffer %zu byte%s%s", rx.depth, rx.buflen,
+			rx.fixed_bufs ? ", fixed buffers" : "",
+			opts.io_flags & IOF_SQPOLL ? ", sqpoll" : "");
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	uring_rx_prep_recv(&rx);
+
+	while (!rx.done || rx.writes) {
+		cqe = uring_peek_cqe(&rx.ring);
+
+		if (uring_submit_and_wait(&rx.ring, cqe ? 0 : 1) < 0)
+			err_sys_die(EXIT_FAILMISC, "Failure in io_uring_enter");
+
+		while ((cqe = uring_peek_cqe(&rx.ring)) != NULL) {
+			uring_rx_complete(&rx, cqe);
+			uring_cqe_seen(&rx.ring);
+		}
+
+		/* a multishot recv ends if the ring ran empty */
+		if (!rx.armed && !rx.done && rx.writes < rx.depth)
+			uring_rx_prep_recv(&rx);
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	ns->total_rx_calls += rx.ring.enter_calls;
+	ns->total_rx_sqes += rx.ring.sqes;
+
+	uring_buf_ring_exit(&rx.ring, &rx.br);
+	uring_exit(&rx.ring);
+	free(iov);
+	free(rx.buf);
+	free(rx.pool);
+
+	return ns->total_rx_bytes;
+#else
+	(void) file_fd; (void) connected_fd; (void) phi; (void) ns; (void) buflen;
+	err_msg_die(EXIT_FAILMISC, "io_uring support not compiled in");
+#endif
+}
+
+
+/* Receive into the output file (-u mmap): the file was extended
+** to its announced size, a window of opts.mmap_window bytes is
+** mapped at a time and the socket is read straight into it - no
+** intermediate buffer and no write(). Every 1/8 window the
+** received pages are flushed (msync) and dropped from the process.
+*/
+static ssize_t
+cs_read_mmap(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns, int buflen)
+{
+	off_t map_offset, map_len, window, pos, end, delta, done, flushed, flush_step;
+	off_t pagesize = getpagesize();
+	struct stat stat_buf;
+	ssize_t rc = 0;
+	char *map;
+
+	msg(STRESSFUL, "receive via mmap io operation");
+
+	xfstat(file_fd, &stat_buf, opts.outfile ? opts.outfile : "stdout");
+	if (!S_ISREG(stat_buf.st_mode) || phi->data_size == 0) {
+		msg(GENTLE, "mmap requires a regular output file and a known data size - "
+				"fall back to read/write");
+		return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
+	}
+
+	/* a read into the rest of a window would cut the datagram
+	 * which crosses the window end */
+	if (opts.socktype == SOCK_DGRAM) {
+		msg(GENTLE, "mmap receive needs a stream socket - fall back to read/write");
+		return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
+	}
+
+	pos = phi->stream_offset;
+	end = pos + phi->data_size;
+
+	window = opts.mmap_window ? opts.mmap_window : DEFAULT_MMAP_WINDOW;
+	window = (window + pagesize - 1) & ~(pagesize - 1);
+	flush_step = max(window / 8, (off_t) 1024 * 1024);
+
+	msg(LOUDISH, "mmap window %lld byte", (long long) window);
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	while (pos < end) {
+
+		/* mmap offsets must be page aligned, stream offsets need not */
+		map_offset = pos & ~(pagesize - 1);
+		map_len = min(window, end - map_offset);
+		delta = pos - map_offset;
+
+		map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, file_fd, map_offset);
+		if (map == MAP_FAILED)
+			err_sys_die(EXIT_FAILMISC, "Can't mmap output file");
+		if (madvise(map, map_len, MADV_SEQUENTIAL))
+			err_sys("madvise");	/* do not exit */
+		ns->mmap_windows++;
+
+		for (done = delta, flushed = 0; done < map_len; done += rc) {
+			rc = read(connected_fd, map + done, map_len - done);
+			if (rc < 0 && errno == EINTR) {
+				rc = 0;
+				continue;
+			}
+			if (rc <= 0)
+				break;
+
+			ns->total_rx_calls++;
+			ns->total_rx_bytes += rc;
+
+			if (done + rc - flushed >= flush_step) {
+				off_t upto = (done + rc) & ~(pagesize - 1);
+
+				msync(map + flushed, upto - flushed, MS_ASYNC);
+				madvise(map + flushed, upto - flushed, MADV_DONTNEED);
+				flushed = upto;
+			}
+		}
+		pos = map_offset + done;
+
+		msync(map + flushed, done - flushed, MS_ASYNC);
+		if (munmap(map, map_len) == -1)
+			err_sys("Can't munmap output file");
+
+		if (rc < 0)
+			err_sys("read failed");
+		if (rc <= 0)
+			break;
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	/* the peer sent less than announced, cut the zeroes */
+	if (pos < end) {
+		err_msg("Incomplete transfer: %llu of %llu bytes", ns->total_rx_bytes,
+				phi->data_size);
+		if (phi->stream_count == 1 && ftruncate(file_fd, pos))
+			err_sys("Can't truncate output file");
+	}
+	return rc;
+}
+
+
 /* This is our inner receive function.
 ** It reads from a connected socket descriptor
-** and write to the file descriptor
+** and write to the file descriptor. If the peer
+** transmits parallel streams (-P) the data is written
+** at the stream offset.
 */
 static ssize_t
-cs_read(int file_fd, int connected_fd, struct peer_header_info *phi)
+cs_read(int file_fd, int connected_fd, struct peer_header_info *phi,
+		struct net_stat *ns)
 {
 	int buflen;
-	ssize_t rc;
-	char *buf;
 
 	/* user option or default(DEFAULT_BUFSIZE) */
 	buflen = (opts.buffer_size == 0) ? DEFAULT_BUFSIZE : opts.buffer_size;
 
-	buf = xmalloc(buflen);
+	/* coalesced datagrams need room for 64 KiB */
+	if (opts.udp_gro)
+		buflen = max(buflen, UDP_GRO_BUFLEN);
 
-	touch_use_stat(TOUCH_BEFORE_OP, &net_stat.use_stat_start);
+	if (phi->sequenced)
+		return cs_read_seq(file_fd, connected_fd, phi, ns);
 
-	/* main client loop */
-	while ((rc = read(connected_fd, buf, buflen)) > 0) {
-		ssize_t ret;
-		net_stat.total_rx_calls++;
-		net_stat.total_rx_bytes += rc;
-		do {
-			ret = write(file_fd, buf, rc);
-		} while (ret == -1 && errno == EINTR);
+	if (opts.mmsg_batch || opts.udp_gro)
+		return cs_read_mmsg(file_fd, connected_fd, phi, ns, buflen);
 
-		if (ret != rc) {
-			err_sys("write failed");
-			break;
-		}
+	if (opts.io_call == IO_SPLICE)
+		return cs_read_splice(file_fd, connected_fd, phi, ns);
 
-		if (net_stat.total_rx_bytes >= phi->data_size && phi->data_size != 0) {
+	if (opts.io_call == IO_URING)
+		return cs_read_uring(file_fd, connected_fd, phi, ns, buflen);
 
-			/* we are at the end of the
-			 * announced data amount. Protocols like
-			 * TCP indicate the end of the data stream.
-			 * Datagramm based protocols like UDP or
-			 * UDPLite not. So we break here if we received
-			 * the former announced amount of data */
-			break;
-		}
+	if (opts.io_call == IO_MMAP)
+		return cs_read_mmap(file_fd, connected_fd, phi, ns, buflen);
 
-		if (opts.delay_read) {
-			msg(LOUDISH, "delay read() operation for %d seconds", opts.delay_read);
-			sleep(opts.delay_read);
-		}
+	if (opts.io_flags & IOF_ZEROCOPY)
+		return cs_read_tcp_zc(file_fd, connected_fd, phi, ns, buflen);
 
-	}
+	if (opts.io_flags & IOF_PIPELINE)
+		return cs_read_pipeline(file_fd, connected_fd, phi, ns, buflen);
 
-	touch_use_stat(TOUCH_AFTER_OP, &net_stat.use_stat_end);
-	free(buf);
-	return rc;
+	if (opts.io_flags & (IOF_DIRECT | IOF_DONTCACHE))
+		return cs_read_uncached(file_fd, connected_fd, phi, ns, buflen);
+
+	return cs_read_rw(file_fd, connected_fd, phi, ns, buflen);
 }
 
 
@@ -271,9 +1985,11 @@ instigate_cs(void)
 		err_msg_die(EXIT_FAILNET, "Don't found a suitable address for binding, giving up "
 				"(TIP: start program with strace(2) to find the problen\n");
 
-	ret = sock_callbacks.cb_listen(fd, BACKLOG);
+	/* parallel streams (-P) connect all at once and we
+	** don't know their number until the first header arrived */
+	ret = sock_callbacks.cb_listen(fd, MAX_STREAMS);
 	if (ret < 0)
-		err_sys_die(EXIT_FAILNET, "listen(fd: %d, backlog: %d) failed", fd, BACKLOG);
+		err_sys_die(EXIT_FAILNET, "listen(fd: %d, backlog: %d) failed", fd, MAX_STREAMS);
 
 	freeaddrinfo(hostres);
 	return fd;
@@ -294,6 +2010,546 @@ tcp_set_md5sig_option(int fd)
 }
 
 
+static int
+accept_peer(int server_fd)
+{
+	int ret, fd;
+	char peer[1024], portstr[8];
+	struct sockaddr_storage sa;
+	socklen_t sa_len = sizeof(sa);
+
+	fd = accept(server_fd, (struct sockaddr *) &sa, &sa_len);
+	if (fd == -1)
+		err_sys_die(EXIT_FAILNET, "accept");
+	ret = getnameinfo((struct sockaddr *)&sa, sa_len, peer,
+			sizeof(peer), portstr, sizeof(portstr), NI_NUMERICSERV|NI_NUMERICHOST);
+	if (ret != 0)
+		err_msg("getnameinfo error: %s",  gai_strerror(ret));
+	msg(GENTLE, "accept from %s:%s", peer, portstr);
+
+	return fd;
+}
+
+
+struct rx_stream {
+	pthread_t tid;
+	int file_fd;
+	int connected_fd;
+	struct peer_header_info *phi;
+	struct net_stat ns;
+};
+
+
+static void *rx_stream_main(void *arg)
+{
+	struct rx_stream *rs = arg;
+
+	cs_read(rs->file_fd, rs->connected_fd, rs->phi, &rs->ns);
+
+	msg(LOUDISH, "stream %u done (%llu bytes)", rs->phi->stream_index,
+			rs->ns.total_rx_bytes);
+
+	close(rs->connected_fd);
+	return NULL;
+}
+
+
+/* reserve the announced data before the first byte arrives,
+** the mmap receiver writes into the file size */
+static void
+rx_prealloc(int file_fd, const struct peer_header_info *phi, struct net_stat *ns)
+{
+	ns->prealloc = prealloc_output_file(file_fd, phi->stream_offset, phi->data_size,
+			opts.io_call == IO_MMAP && !phi->sequenced);
+}
+
+
+static void
+rx_stream_start(struct rx_stream *rs, int file_fd, int connected_fd,
+		struct peer_header_info *phi)
+{
+	int ret;
+
+	rs->file_fd = file_fd;
+	rs->connected_fd = connected_fd;
+	rs->phi = phi;
+
+	/* still in the main thread, so the file only grows */
+	rx_prealloc(file_fd, phi, &rs->ns);
+
+	ret = pthread_create(&rs->tid, NULL, rx_stream_main, rs);
+	if (ret)
+		err_msg_die(EXIT_FAILMISC, "Can't create stream thread: %s", strerror(ret));
+}
+
+
+/* The peer transmits the file over several connections (-P),
+** phi is the header of the first one. Accept the remaining
+** connections and receive every stream in its own thread.
+*/
+static void
+receive_streams(int file_fd, int server_fd, int connected_fd,
+		struct peer_header_info *phi)
+{
+	unsigned int i, count = phi->stream_count;
+	struct rx_stream *rs;
+	struct stat stat_buf;
+
+	xfstat(file_fd, &stat_buf, opts.outfile ? opts.outfile : "stdout");
+	if (!S_ISREG(stat_buf.st_mode))
+		err_msg_die(EXIT_FAILOPT, "parallel streams (-P) require a regular output file");
+
+	msg(GENTLE, "peer transmits %u parallel streams", count);
+
+	rs = xzalloc(count * sizeof(*rs));
+
+	rx_stream_start(&rs[phi->stream_index], file_fd, connected_fd, phi);
+
+	for (i = 1; i < count; i++) {
+		struct peer_header_info *p;
+		int fd = accept_peer(server_fd);
+
+		set_socketopts(fd);
+
+		if (meta_exchange_rcv(fd, &p))
+			err_msg_die(EXIT_FAILHEADER, "Can't read netsend header of stream connection");
+		if (p->stream_count != count || rs[p->stream_index].phi)
+			err_msg_die(EXIT_FAILHEADER, "unexpected stream %u of %u",
+					p->stream_index, p->stream_count);
+
+		rx_stream_start(&rs[p->stream_index], file_fd, fd, p);
+	}
+
+	for (i = 0; i < count; i++) {
+		pthread_join(rs[i].tid, NULL);
+		net_stat_merge(&net_stat, &rs[i].ns);
+		if (rs[i].phi != phi)
+			free(rs[i].phi);
+	}
+
+	net_stat.streams = count;
+	free(rs);
+}
+
+
+/* Receive daemon (--daemon): instead of one transfer the receiver
+** serves any number of senders until SIGINT or SIGTERM. An epoll
+** loop in the main thread multiplexes the connections, every sender
+** streams into its own file named after the template in opts.outfile.
+** Each connection keeps a struct net_stat of its own which is merged
+** into the global one when the sender is done.
+*/
+#define	DAEMON_HDR_TIMEOUT 5 /* seconds a sender may take for its header */
+#define	DAEMON_READ_BURST 16 /* reads per wakeup, a fast sender can't starve the others */
+#define	DAEMON_MAX_EVENTS 64
+
+struct rx_conn {
+	struct rx_conn *next;
+	int fd;
+	int file_fd;
+	bool failed;
+	struct peer_header_info *phi;
+	struct rx_sync rsync;
+	off_t offset;
+	struct net_stat ns;
+	char peer[NI_MAXHOST + NI_MAXSERV + 1];
+	char path[PATH_MAX];
+};
+
+static volatile sig_atomic_t rx_daemon_stop;
+
+static void rx_daemon_signal(int signo)
+{
+	(void) signo;
+	rx_daemon_stop = 1;
+}
+
+
+/* Take over an accepted sender: read its header, which blocks but
+** no longer than DAEMON_HDR_TIMEOUT, and create its output file.
+** NULL if the sender was turned away.
+*/
+static struct rx_conn *
+rx_conn_open(int fd, struct sockaddr_storage *sa, socklen_t sa_len,
+		unsigned long long n)
+{
+	int ret, flags;
+	char host[NI_MAXHOST], port[NI_MAXSERV];
+	struct timeval tv = { .tv_sec = DAEMON_HDR_TIMEOUT };
+	struct rx_conn *c;
+
+	ret = getnameinfo((struct sockaddr *) sa, sa_len, host, sizeof(host),
+			port, sizeof(port), NI_NUMERICSERV | NI_NUMERICHOST);
+	if (ret != 0) {
+		err_msg("getnameinfo error: %s", gai_strerror(ret));
+		strcpy(host, "unknown");
+		strcpy(port, "0");
+	}
+	msg(GENTLE, "accept from %s:%s (connection %llu)", host, port, n);
+
+	c = xzalloc(sizeof(*c));
+	c->fd = fd;
+	c->file_fd = -1;
+	snprintf(c->peer, sizeof(c->peer), "%s:%s", host, port);
+
+	set_socketopts(fd);
+	xsetsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv), "SO_RCVTIMEO");
+
+	if (meta_exchange_rcv(fd, &c->phi)) {
+		err_msg("%s: can't read netsend header", c->peer);
+		goto reject;
+	}
+	if (c->phi->stream_count > 1) {
+		err_msg("%s: the daemon doesn't serve parallel streams (-P)", c->peer);
+		goto reject;
+	}
+
+	c->file_fd = open_conn_output_file(opts.outfile, host, port, n,
+			c->path, sizeof(c->path));
+	if (c->file_fd == -1)
+		goto reject;
+
+	/* from now on the epoll loop decides when to read */
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+		err_sys("%s: can't make the socket non-blocking", c->peer);
+		close(c->file_fd);
+		unlink(c->path);
+		goto reject;
+	}
+
+	rx_prealloc(c->file_fd, c->phi, &c->ns);
+	rx_sync_init(&c->rsync, c->file_fd, 0);
+	msg(LOUDISH, "%s: receive into %s", c->peer, c->path);
+
+	touch_use_stat(TOUCH_BEFORE_OP, &c->ns.use_stat_start);
+	return c;
+
+reject:
+	close(fd);
+	free(c->phi);
+	free(c);
+	return NULL;
+}
+
+
+/* Read what the sender delivered, at most DAEMON_READ_BURST times -
+** the socket stays readable and epoll reports it again. True if the
+** connection is done: end of data, the announced amount or an error.
+*/
+static bool
+rx_conn_read(struct rx_conn *c, char *buf, int buflen)
+{
+	int i;
+
+	for (i = 0; i < DAEMON_READ_BURST; i++) {
+		struct timespec start;
+		ssize_t rc, ret;
+
+		rc = read(c->fd, buf, buflen);
+		if (rc == 0)
+			return true;
+		if (rc < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return false;
+			err_sys("%s: read failed", c->peer);
+			c->failed = true;
+			return true;
+		}
+		c->ns.total_rx_calls++;
+		c->ns.total_rx_bytes += rc;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			ret = write(c->file_fd, buf, rc);
+		} while (ret == -1 && errno == EINTR);
+		write_time_account(&c->ns, &start);
+
+		if (ret != rc) {
+			err_sys("%s: write to %s failed", c->peer, c->path);
+			c->failed = true;
+			return true;
+		}
+		c->offset += rc;
+		rx_sync_advance(&c->rsync, c->offset, &c->ns);
+
+		if (c->phi->data_size != 0 && c->ns.total_rx_bytes >= c->phi->data_size)
+			return true;
+	}
+
+	return false;
+}
+
+
+/* sync the file of a sender, report and account the connection -
+** in the closer thread */
+static void
+rx_conn_close(struct rx_conn *c)
+{
+	struct timespec start;
+	bool complete;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fsync(c->file_fd);
+	c->ns.sync_ns = ns_since(&start);
+	gettimeofday(&c->ns.durable, NULL);
+
+	/* a data size of 0 is unknown, then the sender ends with the connection */
+	complete = !c->failed && (c->phi->data_size == 0 ||
+			c->ns.total_rx_bytes >= c->phi->data_size);
+
+	msg(GENTLE, "%s done, %llu byte into %s%s", c->peer, c->ns.total_rx_bytes,
+			c->path, complete ? "" : " (incomplete)");
+
+	if (opts.statistics && !opts.machine_parseable) {
+		char line[PATH_MAX + 256];
+
+		gen_conn_analyse(line, sizeof(line), c->peer, c->path, &c->ns);
+		fputs(line, stderr);
+		fflush(stderr);
+	}
+
+	net_stat_merge(&net_stat, &c->ns);
+	net_stat.sync_ns += c->ns.sync_ns;
+	net_stat.durable = c->ns.durable;
+	if (complete)
+		net_stat.conn_complete++;
+	else
+		net_stat.conn_incomplete++;
+
+	close(c->file_fd);
+	free(c->phi);
+	free(c);
+}
+
+
+/* The final fsync of a large file takes seconds, within the epoll
+** loop it would stall every other sender. The loop ends the transfer
+** and closes the socket, a closer thread takes over the file: it
+** syncs, reports and accounts the connections in the order they
+** finished. Only this thread merges into net_stat.
+*/
+struct rx_closer {
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct rx_conn *head;
+	struct rx_conn **tail;
+	bool stop;
+};
+
+
+static void *rx_closer_main(void *arg)
+{
+	struct rx_closer *cl = arg;
+
+	pthread_mutex_lock(&cl->lock);
+	for (;;) {
+		struct rx_conn *c = cl->head;
+
+		if (!c) {
+			if (cl->stop)
+				break;
+			pthread_cond_wait(&cl->cond, &cl->lock);
+			continue;
+		}
+		cl->head = c->next;
+		if (!cl->head)
+			cl->tail = &cl->head;
+
+		pthread_mutex_unlock(&cl->lock);
+		rx_conn_close(c);
+		pthread_mutex_lock(&cl->lock);
+	}
+	pthread_mutex_unlock(&cl->lock);
+
+	return NULL;
+}
+
+
+static void
+rx_closer_start(struct rx_closer *cl)
+{
+	int ret;
+
+	memset(cl, 0, sizeof(*cl));
+	cl->tail = &cl->head;
+	pthread_mutex_init(&cl->lock, NULL);
+	pthread_cond_init(&cl->cond, NULL);
+
+	ret = pthread_create(&cl->tid, NULL, rx_closer_main, cl);
+	if (ret)
+		err_msg_die(EXIT_FAILMISC, "Can't create closer thread: %s", strerror(ret));
+}
+
+
+/* the transfer of c is over: stop the clock, release the peer and
+** queue the file for the closer thread */
+static void
+rx_conn_done(struct rx_closer *cl, struct rx_conn *c)
+{
+	touch_use_stat(TOUCH_AFTER_OP, &c->ns.use_stat_end);
+	close(c->fd);
+
+	c->next = NULL;
+	pthread_mutex_lock(&cl->lock);
+	*cl->tail = c;
+	cl->tail = &c->next;
+	pthread_cond_signal(&cl->cond);
+	pthread_mutex_unlock(&cl->lock);
+}
+
+
+/* wait until every queued file is synced */
+static void
+rx_closer_stop(struct rx_closer *cl)
+{
+	pthread_mutex_lock(&cl->lock);
+	cl->stop = true;
+	pthread_cond_signal(&cl->cond);
+	pthread_mutex_unlock(&cl->lock);
+
+	pthread_join(cl->tid, NULL);
+	pthread_cond_destroy(&cl->cond);
+	pthread_mutex_destroy(&cl->lock);
+}
+
+
+/* accept every pending sender of the non-blocking listening socket */
+static void
+rx_daemon_accept(int server_fd, int epoll_fd, struct rx_conn **conns,
+		unsigned int *active, unsigned long long *n)
+{
+	for (;;) {
+		struct sockaddr_storage sa;
+		socklen_t sa_len = sizeof(sa);
+		struct epoll_event ev = { .events = EPOLLIN };
+		struct rx_conn *c;
+		int fd;
+
+		/* the accepted socket is blocking, the header is read in one go */
+		fd = accept(server_fd, (struct sockaddr *) &sa, &sa_len);
+		if (fd == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+				errno != ECONNABORTED && errno != EINTR)
+				err_sys("accept");
+			return;
+		}
+
+		c = rx_conn_open(fd, &sa, sa_len, ++*n);
+		if (!c) {
+			net_stat.conn_rejected++;
+			continue;
+		}
+
+		ev.data.ptr = c;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->fd, &ev))
+			err_sys_die(EXIT_FAILMISC, "epoll_ctl(EPOLL_CTL_ADD)");
+
+		c->next = *conns;
+		*conns = c;
+		++*active;
+		net_stat.conn_peak = max(net_stat.conn_peak, *active);
+	}
+}
+
+
+/* The daemon serves tcp only - a datagram or multicast receiver
+** has no connection per sender to tell the transfers apart.
+*/
+static void
+receive_daemon(void)
+{
+	int server_fd, epoll_fd, buflen;
+	unsigned int active = 0;
+	unsigned long long n = 0;
+	char *buf;
+	struct rx_conn *conns = NULL;
+	struct rx_closer closer;
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	struct epoll_event events[DAEMON_MAX_EVENTS];
+	struct sigaction sa = { .sa_handler = rx_daemon_signal };
+	sigset_t stop_mask, orig_mask;
+
+	msg(GENTLE, "receiver daemon mode");
+
+	server_fd = instigate_cs();
+	set_socketopts(server_fd);
+	if (opts.tcp_use_md5sig)
+		tcp_set_md5sig_option(server_fd);
+
+	if (fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK))
+		err_sys_die(EXIT_FAILNET, "Can't make the listening socket non-blocking");
+
+	/* SIGINT and SIGTERM are only delivered within epoll_pwait(),
+	** a connection is never cut in the middle of a read or write */
+	sigemptyset(&stop_mask);
+	sigaddset(&stop_mask, SIGINT);
+	sigaddset(&stop_mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &stop_mask, &orig_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1)
+		err_sys_die(EXIT_FAILMISC, "epoll_create1");
+
+	/* data.ptr NULL is the listening socket, else the rx_conn */
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev))
+		err_sys_die(EXIT_FAILMISC, "epoll_ctl(EPOLL_CTL_ADD)");
+
+	buflen = (opts.buffer_size == 0) ? DEFAULT_BUFSIZE : opts.buffer_size;
+	buf = xmalloc(buflen);
+
+	rx_closer_start(&closer);
+
+	while (!rx_daemon_stop) {
+		int i, nev;
+
+		nev = epoll_pwait(epoll_fd, events, DAEMON_MAX_EVENTS, -1, &orig_mask);
+		if (nev == -1) {
+			if (errno == EINTR)
+				continue;
+			err_sys_die(EXIT_FAILMISC, "epoll_pwait");
+		}
+
+		for (i = 0; i < nev; i++) {
+			struct rx_conn *c = events[i].data.ptr, **cp;
+
+			if (!c) {
+				rx_daemon_accept(server_fd, epoll_fd, &conns, &active, &n);
+				continue;
+			}
+
+			if (!rx_conn_read(c, buf, buflen))
+				continue;
+
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+			for (cp = &conns; *cp != c; cp = &(*cp)->next)
+				;
+			*cp = c->next;
+			rx_conn_done(&closer, c);
+			active--;
+		}
+	}
+
+	msg(GENTLE, "receiver daemon stops, %u senders still connected", active);
+
+	/* whoever is still connected ends incomplete */
+	while (conns) {
+		struct rx_conn *c = conns;
+
+		conns = c->next;
+		rx_conn_done(&closer, c);
+	}
+	rx_closer_stop(&closer);
+
+	free(buf);
+	close(epoll_fd);
+	close(server_fd);
+	sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+}
+
+
 /* *** Main Client Routine ***
 **
 ** o initialize client socket
@@ -304,11 +2560,16 @@ tcp_set_md5sig_option(int fd)
 void
 receive_mode(void)
 {
-	int ret, file_fd, connected_fd = -1, server_fd;
+	int file_fd, connected_fd = -1, server_fd;
 	struct sockaddr_storage sa;
 	struct peer_header_info *phi = NULL;
 	socklen_t sa_len = sizeof(sa);
 
+	if (opts.rx_daemon) {
+		receive_daemon();
+		return;
+	}
+
 	msg(GENTLE, "receiver mode");
 
 	file_fd = open_output_file();
@@ -334,21 +2595,15 @@ receive_mode(void)
 	switch (opts.protocol) {
 	case IPPROTO_TCP:
 	case IPPROTO_DCCP:
-	case IPPROTO_SCTP: {
-		char peer[1024], portstr[8];
-
+	case IPPROTO_SCTP:
 		if (opts.tcp_use_md5sig)
 			tcp_set_md5sig_option(server_fd);
 
-		connected_fd = accept(server_fd, (struct sockaddr *) &sa, &sa_len);
-		if (connected_fd == -1)
-			err_sys_die(EXIT_FAILNET, "accept");
-		ret = getnameinfo((struct sockaddr *)&sa, sa_len, peer,
-				sizeof(peer), portstr, sizeof(portstr), NI_NUMERICSERV|NI_NUMERICHOST);
-		if (ret != 0)
-			err_msg("getnameinfo error: %s",  gai_strerror(ret));
-		msg(GENTLE, "accept from %s:%s", peer, portstr);
-		}
+		connected_fd = accept_peer(server_fd);
+		break;
+	case IPPROTO_UDP:
+		if (opts.udp_gro)
+			udp_setsockopt_gro(connected_fd);
 		break;
 	case IPPROTO_UDPLITE:
 		if (opts.udplite_checksum_coverage != LONG_MAX)
@@ -359,7 +2614,8 @@ receive_mode(void)
 	set_socketopts(connected_fd);
 
 	/* read netsend header */
-	meta_exchange_rcv(connected_fd, &phi);
+	if (meta_exchange_rcv(connected_fd, &phi))
+		err_msg_die(EXIT_FAILHEADER, "Can't read netsend header");
 
 	if (opts.delay_read_initial > 0) {
 		msg(LOUDISH, "delay the initial read() for %d seconds", opts.delay_read_initial);
@@ -368,11 +2624,18 @@ receive_mode(void)
 
 	msg(LOUDISH, "block in read");
 
-	cs_read(file_fd, connected_fd, phi);
+	if (phi->stream_count > 1) {
+		receive_streams(file_fd, server_fd, connected_fd, phi);
+		connected_fd = -1;
+	} else {
+		net_stat.streams = 1;
+		rx_prealloc(file_fd, phi, &net_stat);
+		cs_read(file_fd, connected_fd, phi, &net_stat);
+	}
 
 	msg(LOUDISH, "done");
 
-	if (opts.protocol == IPPROTO_TCP && VL_STRESSFUL(opts.verbose)) {
+	if (connected_fd != -1 && opts.protocol == IPPROTO_TCP && VL_STRESSFUL(opts.verbose)) {
 		struct tcp_info tcp_info;
 
 		if (tcp_get_info(connected_fd, &tcp_info))
@@ -380,9 +2643,17 @@ receive_mode(void)
 	}
 	/* We sync the file descriptor here because in a worst
 	** case this call block and sophisticate the time
-	** measurement.
+	** measurement. The time it takes is reported on its own,
+	** together with the time until the data was durable.
 	*/
-	fsync(file_fd);
+	{
+		struct timespec start;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		fsync(file_fd);
+		net_stat.sync_ns = ns_since(&start);
+		gettimeofday(&net_stat.durable, NULL);
+	}
 	free(phi);
 	if (opts.family == AF_UNIX && unlink(opts.port)) /* remove unix sun_path */
 		err_sys("unlink %s", opts.port);
@@ -33,19 +33,32 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
 
 #include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <arpa/inet.h>
 
+#include "analyze.h"
 #include "debug.h"
 #include "global.h"
 #include "xfuncs.h"
 //#include "proto_tipc.h"
 #include "proto_tcp.h"
+#include "proto_udp.h"
+#include "ns_hdr.h"
+#include "uring.h"
 
 
 extern struct opts opts;
@@ -86,151 +99,1463 @@ static int get_mem_adv_f(int adv)
 }
 
 
-static ssize_t write_len(int fd, const void *buf, size_t len)
+/* --rate: a token bucket per stream thread. Every send takes
+** its bytes from the bucket, a negative fill level is paid by
+** sleeping until the bucket is refilled. The bucket holds at most
+** one burst - so an idle sender can't save up credit. Stream
+** sockets are written in burst sized pieces, datagrams as a whole.
+*/
+#define	RATE_BURST_USEC 1000
+#define	RATE_BURST_MIN  4096
+
+struct rate_bucket {
+	bool active;
+	bool stream;
+	double rate;   /* < byte per second */
+	double burst;  /* < byte */
+	double tokens; /* < byte */
+	struct timespec last;
+};
+
+static __thread struct rate_bucket rate_bucket;
+
+
+static double ts_diff(const struct timespec *end, const struct timespec *start)
+{
+	return (end->tv_sec - start->tv_sec) +
+		(end->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+
+static void rate_init(int connected_fd, struct stream_desc *sd)
+{
+	struct rate_bucket *rb = &rate_bucket;
+	unsigned long long pacing;
+
+	memset(rb, 0, sizeof(*rb));
+	if (!opts.rate)
+		return;
+
+	/* parallel streams share the rate */
+	rb->rate = (double) opts.rate / 8 / sd->count;
+	rb->burst = max(rb->rate * RATE_BURST_USEC / 1000000, (double) RATE_BURST_MIN);
+	rb->tokens = rb->burst;
+	rb->stream = opts.socktype == SOCK_STREAM;
+	rb->active = true;
+	clock_gettime(CLOCK_MONOTONIC, &rb->last);
+
+	sd->ns->rate_burst = rb->burst;
+
+	/* the kernel paces on its own if the fq qdisc (or TCP internal
+	** pacing) is in use, the bucket then only catches the bursts */
+	pacing = rb->rate;
+	if (setsockopt(connected_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &pacing, sizeof(pacing)))
+		msg(LOUDISH, "setsockopt SO_MAX_PACING_RATE failed: %s", strerror(errno));
+	else
+		sd->ns->rate_kernel = true;
+
+	msg(GENTLE, "rate limit %.0f byte/s, burst %.0f byte", rb->rate, rb->burst);
+}
+
+
+/* the largest piece of len bytes which may be sent at once */
+static size_t rate_chunk(size_t len)
+{
+	struct rate_bucket *rb = &rate_bucket;
+
+	if (!rb->active || !rb->stream)
+		return len;
+	return min(len, (size_t) rb->burst);
+}
+
+
+static void rate_limit(size_t bytes)
+{
+	struct rate_bucket *rb = &rate_bucket;
+	struct timespec now, ts;
+	double wait;
+
+	if (!rb->active)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	rb->tokens = min(rb->burst, rb->tokens + ts_diff(&now, &rb->last) * rb->rate);
+	rb->last = now;
+
+	rb->tokens -= bytes;
+	if (rb->tokens >= 0)
+		return;
+
+	wait = -rb->tokens / rb->rate;
+	ts.tv_sec = wait;
+	ts.tv_nsec = (wait - ts.tv_sec) * 1000000000.0;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR)
+		;
+}
+
+
+#ifdef HAVE_IO_URING
+/* the bytes which may be queued at once */
+static size_t rate_budget(void)
+{
+	struct rate_bucket *rb = &rate_bucket;
+
+	return rb->active ? (size_t) rb->burst : SIZE_MAX;
+}
+
+
+/* give back the charge of bytes which were not sent */
+static void rate_refund(size_t bytes)
+{
+	struct rate_bucket *rb = &rate_bucket;
+
+	if (rb->active)
+		rb->tokens = min(rb->burst, rb->tokens + bytes);
+}
+#endif
+
+
+static ssize_t write_len(int fd, const void *buf, size_t len, struct net_stat *ns)
+{
+	const char *bufptr = buf;
+	ssize_t total = 0;
+	do {
+		ssize_t written = sock_callbacks.cb_write(fd, bufptr, rate_chunk(len));
+		ns->total_tx_calls += 1;
+		if (written < 0) {
+			int real_errno;
+
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+
+			real_errno = errno;
+			err_msg("Could not write %u bytes: %s", len, strerror(errno));
+			if (opts.protocol == IPPROTO_SCTP && real_errno == EMSGSIZE) {
+				err_msg("for SCTP the maximum size of data that can be sent in a "
+					"single send call is limited by SO_SNDBUF.\n"
+					"Either increase send buffer size (-s SO_SNDBUF) or "
+					"lower the write buffer size (-b)");
+
+			}
+			errno = real_errno;
+			break;
+		}
+		rate_limit(written);
+		total += written;
+		bufptr += written;
+		len -= written;
+	} while (len > 0);
+
+	return total > 0 ? total : -1;
+}
+
+
+/* MSG_ZEROCOPY: the kernel references the pages of a send buffer
+** until the data is acknowledged, the buffer must not be reused
+** before. Every successful send call gets an id, completions are
+** reported as id ranges on the socket error queue. For stream
+** sockets the ranges arrive in order.
+*/
+struct zc_state {
+	int fd;
+	uint32_t next_id; /* < id of the next zero copy send call */
+	uint32_t done_id; /* < all send calls below are completed */
+	struct net_stat *ns;
+};
+
+
+static bool zc_init(struct zc_state *zc, int fd, struct net_stat *ns)
+{
+	int on = 1;
+
+	memset(zc, 0, sizeof(*zc));
+	zc->fd = fd;
+	zc->ns = ns;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+		err_msg("Can't set SO_ZEROCOPY: %s - use copying sends", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+
+/* process one batch of completions from the error queue, if
+** block is set wait until a completion arrives */
+static void zc_reap(struct zc_state *zc, bool block)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct sock_extended_err *serr;
+	struct pollfd pfd;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(zc->fd, &msg, MSG_ERRQUEUE) >= 0)
+			break;
+
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN)
+			err_sys_die(EXIT_FAILNET, "Can't read socket error queue");
+		if (!block)
+			return;
+
+		/* a non empty error queue is signaled via POLLERR */
+		pfd.fd = zc->fd;
+		pfd.events = 0;
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			err_sys_die(EXIT_FAILNET, "Failure in poll");
+	}
+
+	for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+		uint32_t n;
+
+		if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+			!(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+			continue;
+
+		serr = (struct sock_extended_err *) CMSG_DATA(cm);
+		if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0)
+			continue;
+
+		n = serr->ee_data - serr->ee_info + 1;
+		if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+			zc->ns->total_tx_zc_copied += n;
+		else
+			zc->ns->total_tx_zc += n;
+		zc->done_id = serr->ee_data + 1;
+	}
+}
+
+
+/* wait until send call id is completed */
+static void zc_wait(struct zc_state *zc, uint32_t id)
+{
+	while ((int32_t) (id - zc->done_id) >= 0)
+		zc_reap(zc, true);
+}
+
+
+/* wait for all outstanding completions */
+static void zc_finish(struct zc_state *zc)
+{
+	if (zc->next_id)
+		zc_wait(zc, zc->next_id - 1);
+}
+
+
+#define	ZC_BACKOFF_MIN_NS  50000L
+#define	ZC_BACKOFF_MAX_NS  10000000L
+
+/* the socket is out of option memory although no completion is
+** pending (e.g. used up by other sockets): nothing arrives on the
+** error queue, wait a while - a bit longer each time - and retry */
+static void zc_backoff(long *ns)
+{
+	struct timespec ts = { 0, *ns };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR)
+		;
+	*ns = min(*ns * 2, ZC_BACKOFF_MAX_NS);
+}
+
+
+/* like write_len() but with MSG_ZEROCOPY - the buffer
+** must be kept until zc_wait(zc, zc->next_id - 1) returns */
+static ssize_t write_len_zc(struct zc_state *zc, const void *buf, size_t len)
+{
+	const char *bufptr = buf;
+	ssize_t total = 0;
+	long backoff = ZC_BACKOFF_MIN_NS;
+	int flags = MSG_ZEROCOPY;
+
+	do {
+		ssize_t written = send(zc->fd, bufptr, rate_chunk(len), flags);
+		zc->ns->total_tx_calls += 1;
+		if (written < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			/* optmem limit reached, completions free it - if
+			 * any send is outstanding. Otherwise retry a while,
+			 * then copy the piece */
+			if (errno == ENOBUFS) {
+				if (zc->next_id != zc->done_id)
+					zc_reap(zc, true);
+				else if (backoff < ZC_BACKOFF_MAX_NS)
+					zc_backoff(&backoff);
+				else
+					flags = 0;
+				continue;
+			}
+			err_msg("Could not write %zu bytes: %s", len, strerror(errno));
+			break;
+		}
+		/* a copying send gets no completion id */
+		if (flags)
+			zc->next_id++;
+		flags = MSG_ZEROCOPY;
+		backoff = ZC_BACKOFF_MIN_NS;
+		rate_limit(written);
+		total += written;
+		bufptr += written;
+		len -= written;
+	} while (len > 0);
+
+	return total > 0 ? total : -1;
+}
+
+
+/* return the number of bytes to read next: the buffer size
+** or less at the end of the stream slice. If the slice is
+** done zero is returned, read(2) will then indicate EOF.
+*/
+static size_t slice_chunk(const struct stream_desc *sd, off_t done, size_t buflen)
+{
+	if (sd->size == 0 || sd->size - done >= (off_t) buflen)
+		return buflen;
+	return sd->size - done;
+}
+
+
+/* the transfer limit (-l) counts chunks of the user's buffer size,
+** not the buffers an engine reads with (-b auto, UDP GSO, O_DIRECT) */
+static unsigned long long tx_barrier(void)
+{
+	return (unsigned long long) (opts.buffer_size ? opts.buffer_size : DEFAULT_BUFSIZE) *
+		opts.multiple_barrier;
+}
+
+
+/* O_DIRECT transfers must be a multiple of the block size */
+static size_t direct_buflen(size_t buflen)
+{
+	if (!(opts.io_flags & IOF_DIRECT) || buflen % DIRECT_IO_ALIGN == 0)
+		return buflen;
+
+	msg(GENTLE, "O_DIRECT: round buffer length %zu up to %zu", buflen,
+			DIRECT_ALIGN_UP(buflen));
+	return DIRECT_ALIGN_UP(buflen);
+}
+
+
+/* a short read left the file offset unaligned, the next O_DIRECT
+** read would fail with EINVAL - read the rest through the page cache */
+static void direct_drop(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || !(flags & O_DIRECT))
+		return;
+	if (fcntl(fd, F_SETFL, flags & ~O_DIRECT) < 0)
+		err_sys_die(EXIT_FAILMISC, "Can't clear O_DIRECT on %s", opts.infile);
+	msg(GENTLE, "O_DIRECT: short read to an unaligned offset, read the rest cached");
+}
+
+
+/* read the next chunk of the slice. With O_DIRECT whole blocks are
+** read - the tail of a file which is no block multiple is returned
+** short by the kernel, a read beyond the end of a slice is clipped.
+** A short read in the middle of the file is continued, the chunk is
+** only short at the end of file. buf must hold the block aligned
+** length.
+*/
+static ssize_t slice_read(int fd, void *buf, const struct stream_desc *sd,
+		off_t done, size_t chunk)
+{
+	size_t want = slice_chunk(sd, done, chunk), len, got = 0;
+	ssize_t cnt;
+
+	if (!(opts.io_flags & IOF_DIRECT))
+		return read(fd, buf, want);
+
+	len = DIRECT_ALIGN_UP(want);
+	while (got < want) {
+		cnt = read(fd, (char *) buf + got, len - got);
+		if (cnt < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (cnt == 0)
+			break;
+		got += cnt;
+		if (got < want && got % DIRECT_IO_ALIGN)
+			direct_drop(fd);
+	}
+	return min(got, want);
+}
+
+
+
+/* -b auto: the first part of a transfer is sent with a series of
+** chunk sizes, each for a fixed amount of data. Throughput and cpu
+** time per byte of every candidate are sampled, afterwards the
+** fastest chunk size is locked in - or, among all candidates within
+** 5% of the fastest, the one with the least cpu time per byte.
+*/
+static const size_t tuner_sizes[] = {
+	4096, 16384, 65536, 262144, 1048576, 4194304
+};
+
+#define	TUNER_CANDIDATES   ARRAY_SIZE(tuner_sizes)
+#define	TUNER_MAX_CHUNK    4194304
+#define	TUNER_PROBE_MIN    (8ULL * 1024 * 1024)
+#define	TUNER_PROBE_CHUNKS 4
+#define	TUNER_TOLERANCE    0.95
+
+struct chunk_tuner {
+	bool active;
+	unsigned int n;   /* < number of candidates */
+	unsigned int cur; /* < candidate in probe */
+	size_t chunk;     /* < chunk size to use now */
+	unsigned long long bytes; /* < sent with the current candidate */
+	struct use_stat start;
+	double tput[TUNER_CANDIDATES]; /* byte per second */
+	double cpu[TUNER_CANDIDATES];  /* cpu seconds per byte */
+	struct net_stat *ns;
+};
+
+
+/* like touch_use_stat() but thread local - parallel streams
+** tune independently of each other */
+static void tuner_sample(struct use_stat *us)
+{
+	if (gettimeofday(&us->time, NULL) < 0)
+		err_sys("Failure in gettimeofday()");
+	if (getrusage(RUSAGE_THREAD, &us->ru) < 0)
+		err_sys("Failure in getrusage()");
+}
+
+
+static double tv_diff(const struct timeval *end, const struct timeval *start)
+{
+	return (end->tv_sec - start->tv_sec) +
+		(end->tv_usec - start->tv_usec) / 1000000.0;
+}
+
+
+/* max_chunk is the largest sensible chunk for the io call,
+** def is the chunk size used without -b auto. A datagram
+** carries at most UDP_MAX_PAYLOAD byte, a larger chunk fails
+** with EMSGSIZE */
+static void tuner_init(struct chunk_tuner *t, size_t max_chunk, size_t def,
+		struct net_stat *ns)
+{
+	memset(t, 0, sizeof(*t));
+	t->chunk = def;
+	t->ns = ns;
+
+	if (!opts.buffer_auto)
+		return;
+
+	if (opts.socktype == SOCK_DGRAM)
+		max_chunk = min(max_chunk, (size_t) UDP_MAX_PAYLOAD);
+
+	while (t->n < TUNER_CANDIDATES && tuner_sizes[t->n] <= max_chunk)
+		t->n++;
+
+	if (t->n < 2) {
+		msg(GENTLE, "-b auto: nothing to tune, use %zu byte chunks", def);
+		return;
+	}
+
+	t->active = true;
+	t->chunk = tuner_sizes[0];
+	if (opts.socktype == SOCK_DGRAM)
+		msg(GENTLE, "-b auto: datagrams up to %zu byte, the receiver needs -b %zu",
+				tuner_sizes[t->n - 1], tuner_sizes[t->n - 1]);
+	tuner_sample(&t->start);
+}
+
+
+static void tuner_pick(struct chunk_tuner *t)
+{
+	unsigned int i, best = 0;
+
+	/* the transfer may end before all candidates are probed */
+	if (t->cur == 0)
+		goto out;
+
+	for (i = 1; i < t->cur; i++) {
+		if (t->tput[i] > t->tput[best])
+			best = i;
+	}
+	for (i = 0; i < t->cur; i++) {
+		if (t->tput[i] >= t->tput[best] * TUNER_TOLERANCE &&
+			t->cpu[i] < t->cpu[best])
+			best = i;
+	}
+	t->chunk = tuner_sizes[best];
+ out:
+	t->active = false;
+	t->ns->auto_chunk = t->chunk;
+	msg(GENTLE, "-b auto: use %zu byte chunks", t->chunk);
+}
+
+
+/* account sent bytes, switch to the next candidate if
+** the current one has sent enough data */
+static void tuner_account(struct chunk_tuner *t, size_t bytes)
+{
+	struct use_stat now;
+	double real, cpu;
+
+	if (!t->active)
+		return;
+
+	t->bytes += bytes;
+	if (t->bytes < max(TUNER_PROBE_MIN, (unsigned long long) t->chunk * TUNER_PROBE_CHUNKS))
+		return;
+
+	tuner_sample(&now);
+	real = tv_diff(&now.time, &t->start.time);
+	cpu = tv_diff(&now.ru.ru_utime, &t->start.ru.ru_utime) +
+		tv_diff(&now.ru.ru_stime, &t->start.ru.ru_stime);
+
+	t->tput[t->cur] = t->bytes / (real > 0.000001 ? real : 0.000001);
+	t->cpu[t->cur] = cpu / t->bytes;
+
+	msg(LOUDISH, "-b auto: %zu byte chunks: %.2f MiB/s, %.3f ns cpu per byte",
+			t->chunk, t->tput[t->cur] / (1024 * 1024), t->cpu[t->cur] * 1e9);
+
+	if (++t->cur == t->n) {
+		tuner_pick(t);
+		return;
+	}
+
+	t->chunk = tuner_sizes[t->cur];
+	t->bytes = 0;
+	t->start = now;
+}
+
+
+static void tuner_finish(struct chunk_tuner *t)
+{
+	if (t->active)
+		tuner_pick(t);
+}
+
+
+/* Pipelined rw: a reader thread fills a ring of buffers, the
+** sender drains it. head and tail are only written by one side,
+** the handoff is lock free. A side which finds the ring full
+** (reader) respective empty (sender) spins shortly and then sleeps
+** on the futex of the counter it waits for. The pipelined receiver
+** uses the same handoff.
+*/
+
+#define	RING_SPIN 1000
+
+struct rw_ring {
+	uint32_t head;   /* < chunks produced, written by the reader */
+	uint32_t tail;   /* < chunks consumed, written by the sender */
+	uint32_t head_waiter;
+	uint32_t tail_waiter;
+	uint32_t stop;   /* < sender wants no more data */
+	unsigned int nbuf;
+	size_t buflen;
+	unsigned char *buf;
+	ssize_t *len;    /* < bytes in buffer, 0: EOF, -1: read error */
+	int file_fd;
+	int read_errno;
+	struct stream_desc *sd;
+};
+
+
+/* wait until *word differs from val, return true if we had to wait */
+bool ring_wait(uint32_t *word, uint32_t val, uint32_t *waiter)
+{
+	int i;
+
+	if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != val)
+		return false;
+
+	for (i = 0; i < RING_SPIN; i++) {
+		if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != val)
+			return true;
+	}
+
+	__atomic_store_n(waiter, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(word, __ATOMIC_SEQ_CST) == val)
+		syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+	__atomic_store_n(waiter, 0, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+
+void ring_publish(uint32_t *word, uint32_t val, uint32_t *waiter)
+{
+	__atomic_store_n(word, val, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiter, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+
+static void *rw_reader_main(void *arg)
+{
+	struct rw_ring *ring = arg;
+	struct net_stat *ns = ring->sd->ns;
+	uint32_t head = 0;
+	off_t done = 0;
+	ssize_t cnt;
+
+	do {
+		unsigned int idx = head % ring->nbuf;
+
+		/* ring full - wait until the sender releases the oldest buffer */
+		if (ring_wait(&ring->tail, head - ring->nbuf, &ring->tail_waiter))
+			ns->ring_full_stalls++;
+
+		if (__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE)) {
+			cnt = 0;
+		} else {
+			cnt = slice_read(ring->file_fd, ring->buf + idx * ring->buflen,
+					ring->sd, done, ring->buflen);
+			if (cnt < 0)
+				ring->read_errno = errno;
+			else
+				done += cnt;
+		}
+
+		ring->len[idx] = cnt;
+		ring_publish(&ring->head, ++head, &ring->head_waiter);
+	} while (cnt > 0);
+
+	return NULL;
+}
+
+
+static ssize_t trans_rw_pipeline(int file_fd, int connected_fd, struct stream_desc *sd,
+		size_t buflen)
+{
+	struct rw_ring ring;
+	struct net_stat *ns = sd->ns;
+	pthread_t reader;
+	uint32_t tail = 0;
+	ssize_t cnt, cnt_coll = 0;
+	bool drain = false;
+	int ret;
+
+	msg(STRESSFUL, "send via pipelined read/write io operation (%d buffers)",
+			opts.io_depth);
+
+	memset(&ring, 0, sizeof(ring));
+	ring.nbuf = opts.io_depth;
+	ring.buflen = buflen;
+	ring.buf = xmemalign(DIRECT_IO_ALIGN, ring.nbuf * buflen);
+	ring.len = xmalloc(ring.nbuf * sizeof(*ring.len));
+	ring.file_fd = file_fd;
+	ring.sd = sd;
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	ret = pthread_create(&reader, NULL, rw_reader_main, &ring);
+	if (ret)
+		err_msg_die(EXIT_FAILMISC, "Can't create reader thread: %s", strerror(ret));
+
+	for (;;) {
+		unsigned int idx = tail % ring.nbuf;
+
+		/* ring empty - wait for the reader */
+		if (ring_wait(&ring.head, tail, &ring.head_waiter) && !drain)
+			ns->ring_empty_stalls++;
+
+		cnt = ring.len[idx];
+		if (cnt <= 0)
+			break;
+
+		if (!drain) {
+			cnt_coll = write_len(connected_fd, ring.buf + idx * buflen, cnt, ns);
+			if (cnt_coll == -1)
+				drain = true;
+			else
+				ns->total_tx_bytes += cnt_coll;
+
+			/* if we reached a user transfer limit? */
+			if (opts.multiple_barrier && ns->total_tx_bytes >= tx_barrier())
+				drain = true;
+
+			/* tell the reader to stop, the ring is drained until its EOF */
+			if (drain)
+				__atomic_store_n(&ring.stop, 1, __ATOMIC_RELEASE);
+		}
+
+		ring_publish(&ring.tail, ++tail, &ring.tail_waiter);
+	}
+
+	pthread_join(reader, NULL);
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	if (cnt < 0) {
+		errno = ring.read_errno;
+		err_sys("Can't read %s", opts.infile);
+	}
+
+	free(ring.len);
+	free(ring.buf);
+
+	return cnt_coll;
+}
+
+
+/* Batched datagram transmit (-M): one read fills opts.mmsg_batch
+** datagrams of buflen bytes, all of them are handed to the kernel
+** with one sendmmsg(2) call. A short read at the end of the file
+** results in a partially filled batch and a short last datagram.
+** Sequenced mode (-S) uses this path too - with a batch of one if
+** -M is not given: every datagram starts with a struct ns_seq and
+** carries buflen minus this header of file data. The transfer ends
+** with SEQ_END_COPIES end markers.
+*/
+#define	SEQ_END_COPIES 3
+
+static void seq_hdr_fill(struct ns_seq *hdr, unsigned long long seq, uint16_t seg,
+		uint16_t flags, const struct timespec *ts)
+{
+	hdr->seq_hi = htonl(seq >> 32);
+	hdr->seq_lo = htonl(seq & 0xffffffff);
+	hdr->sec = htonl(ts->tv_sec);
+	hdr->nsec = htonl(ts->tv_nsec);
+	hdr->flags = htons(flags);
+	hdr->seg = htons(seg);
+}
+
+
+static void seq_send_end(int connected_fd, unsigned long long seq, uint16_t seg)
+{
+	struct ns_seq hdr;
+	struct timespec ts;
+	int i;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	seq_hdr_fill(&hdr, seq, seg, NS_SEQ_END, &ts);
+
+	/* the end marker may get lost like any other datagram */
+	for (i = 0; i < SEQ_END_COPIES; i++) {
+		if (send(connected_fd, &hdr, sizeof(hdr), 0) < 0)
+			err_sys("Could not send end marker");
+	}
+}
+
+
+/* Reliable multicast (-R): repair rounds after the data. Every
+** round polls the receivers, collects their NAKs on a separate
+** feedback socket - the data socket is connected to the group
+** and would drop unicast replies - and multicasts the union of
+** all NAKed datagrams again. Receivers answer each round, so a
+** lost NAK or acknowledgement is recovered with the next one.
+** It ends when opts.nak_receivers receivers acknowledged the
+** complete file or after NAK_MAX_IDLE rounds without any NAK.
+*/
+#define	NAK_POLL_COPIES 3
+#define	NAK_FEEDBACK_WAIT 100 /* ms without feedback closes a round */
+#define	NAK_MAX_IDLE 30 /* rounds */
+
+static int nak_feedback_socket(int connected_fd, uint16_t *port)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+	int fd;
+
+	if (getsockname(connected_fd, (struct sockaddr *) &ss, &len))
+		err_sys_die(EXIT_FAILNET, "getsockname");
+
+	/* any address, any port of the data socket family */
+	if (ss.ss_family == AF_INET6) {
+		((struct sockaddr_in6 *) &ss)->sin6_addr = in6addr_any;
+		((struct sockaddr_in6 *) &ss)->sin6_port = 0;
+	} else {
+		((struct sockaddr_in *) &ss)->sin_addr.s_addr = htonl(INADDR_ANY);
+		((struct sockaddr_in *) &ss)->sin_port = 0;
+	}
+
+	fd = socket(ss.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0)
+		err_sys_die(EXIT_FAILNET, "socket");
+	if (bind(fd, (struct sockaddr *) &ss, len))
+		err_sys_die(EXIT_FAILNET, "Can't bind feedback socket");
+
+	len = sizeof(ss);
+	if (getsockname(fd, (struct sockaddr *) &ss, &len))
+		err_sys_die(EXIT_FAILNET, "getsockname");
+
+	*port = ntohs(ss.ss_family == AF_INET6 ?
+			((struct sockaddr_in6 *) &ss)->sin6_port :
+			((struct sockaddr_in *) &ss)->sin_port);
+	msg(LOUDISH, "NAK feedback on port %u", *port);
+	return fd;
+}
+
+
+static struct nak_peer *nak_peer_get(struct nak_stat *nk,
+		const struct sockaddr_storage *ss, uint32_t id)
+{
+	const void *ip = ss->ss_family == AF_INET6 ?
+		(const void *) &((const struct sockaddr_in6 *) ss)->sin6_addr :
+		(const void *) &((const struct sockaddr_in *) ss)->sin_addr;
+	struct nak_peer *peer;
+	unsigned int i;
+	size_t len;
+
+	for (i = 0; i < nk->npeers; i++) {
+		if (nk->peer[i].id == id &&
+			!memcmp(&nk->peer[i].ss, ss, sizeof(*ss)))
+			return &nk->peer[i];
+	}
+
+	nk->peer = xrealloc(nk->peer, (nk->npeers + 1) * sizeof(*nk->peer));
+	peer = &nk->peer[nk->npeers++];
+	memset(peer, 0, sizeof(*peer));
+	peer->ss = *ss;
+	peer->id = id;
+
+	if (!inet_ntop(ss->ss_family, ip, peer->addr, INET6_ADDRSTRLEN))
+		strcpy(peer->addr, "?");
+	len = strlen(peer->addr);
+	snprintf(peer->addr + len, sizeof(peer->addr) - len, "#%08x", id);
+
+	msg(LOUDISH, "receiver %s joined the repair rounds", peer->addr);
+	return peer;
+}
+
+
+static void nak_send_poll(int connected_fd, unsigned long long count,
+		uint16_t seg, unsigned int round, uint16_t port)
+{
+	struct {
+		struct ns_seq seq;
+		struct ns_nak_poll poll;
+	} __attribute__((packed)) pkt;
+	struct timespec ts;
+	int i;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	seq_hdr_fill(&pkt.seq, count, seg, NS_SEQ_POLL, &ts);
+	pkt.poll.round = htonl(round);
+	pkt.poll.port = htons(port);
+	pkt.poll.reserved = 0;
+
+	for (i = 0; i < NAK_POLL_COPIES; i++) {
+		if (send(connected_fd, &pkt, sizeof(pkt), 0) < 0)
+			err_sys("Could not send poll");
+	}
+}
+
+
+/* read the feedback of one round into want, return the number of
+** newly wanted datagrams or -1 if no receiver sent a NAK */
+static long long nak_collect(int fb_fd, struct nak_stat *nk, unsigned char *want,
+		unsigned long long count, unsigned int round)
+{
+	struct pollfd pfd = { .fd = fb_fd, .events = POLLIN };
+	const size_t hdrlen = offsetof(struct ns_nak, range);
+	long long nwant = 0;
+	bool nak_seen = false;
+
+	while (nk->acked < opts.nak_receivers && poll(&pfd, 1, NAK_FEEDBACK_WAIT) > 0) {
+		struct sockaddr_storage ss;
+		socklen_t ss_len = sizeof(ss);
+		struct nak_peer *peer;
+		struct ns_nak nak;
+		unsigned int i, nranges;
+		ssize_t len;
+
+		memset(&ss, 0, sizeof(ss));
+		len = recvfrom(fb_fd, &nak, sizeof(nak), 0, (struct sockaddr *) &ss, &ss_len);
+		if (len < (ssize_t) hdrlen || ntohs(nak.magic) != NS_MAGIC ||
+				ntohl(nak.round) != round)
+			continue;
+
+		nranges = ntohs(nak.nranges);
+		if (nranges > NS_NAK_MAX_RANGES ||
+				(size_t) len < hdrlen + nranges * sizeof(nak.range[0]))
+			continue;
+
+		peer = nak_peer_get(nk, &ss, ntohl(nak.id));
+
+		if (nranges == 0) {
+			if (!peer->done_round) {
+				peer->done_round = round;
+				nk->acked++;
+				msg(LOUDISH, "receiver %s complete in round %u", peer->addr, round);
+			}
+			continue;
+		}
+
+		nak_seen = true;
+		peer->naks++;
+		nk->naks++;
+
+		for (i = 0; i < nranges; i++) {
+			unsigned long long seq = ((unsigned long long)
+				ntohl(nak.range[i].start_hi) << 32) | ntohl(nak.range[i].start_lo);
+			unsigned long long end = min(seq + ntohl(nak.range[i].count), count);
+
+			for (; seq < end; seq++) {
+				peer->requested++;
+				if (want[seq >> 3] & (1 << (seq & 7)))
+					continue;
+				want[seq >> 3] |= 1 << (seq & 7);
+				nwant++;
+			}
+		}
+	}
+
+	return nak_seen ? nwant : -1;
+}
+
+
+static void nak_repair(int connected_fd, int file_fd, struct stream_desc *sd,
+		unsigned long long count, size_t payload)
+{
+	struct net_stat *ns = sd->ns;
+	struct nak_stat *nk = &ns->nak;
+	const size_t hdrlen = sizeof(struct ns_seq);
+	unsigned int round, idle = 0;
+	unsigned char *want, *buf;
+	uint16_t port;
+	int fb_fd;
+
+	want = xzalloc(count / 8 + 1);
+	buf = xmalloc(hdrlen + payload);
+	fb_fd = nak_feedback_socket(connected_fd, &port);
+
+	msg(GENTLE, "start repair rounds for %u receivers", opts.nak_receivers);
+
+	for (round = 1; nk->acked < opts.nak_receivers && idle < NAK_MAX_IDLE; round++) {
+		unsigned long long seq;
+		long long nwant;
+
+		nak_send_poll(connected_fd, count, payload, round, port);
+		nk->rounds = round;
+
+		nwant = nak_collect(fb_fd, nk, want, count, round);
+		if (nwant < 0) {
+			idle++;
+			continue;
+		}
+		idle = 0;
+
+		msg(LOUDISH, "round %u: repair %lld datagrams", round, nwant);
+
+		/* multicast the union of all NAKed datagrams */
+		for (seq = 0; nwant > 0 && seq < count; seq++) {
+			struct timespec ts;
+			ssize_t len;
+
+			if (!(want[seq >> 3] & (1 << (seq & 7))))
+				continue;
+			want[seq >> 3] &= ~(1 << (seq & 7));
+			nwant--;
+
+			len = pread(file_fd, buf + hdrlen, payload, sd->offset + (off_t) (seq * payload));
+			if (len <= 0) {
+				err_sys("Can't read %s", opts.infile);
+				continue;
+			}
+
+			clock_gettime(CLOCK_REALTIME, &ts);
+			seq_hdr_fill((struct ns_seq *) buf, seq, payload, NS_SEQ_REPAIR, &ts);
+
+			if (send(connected_fd, buf, hdrlen + len, 0) < 0) {
+				err_sys("Could not send repair");
+				continue;
+			}
+			nk->repairs++;
+			rate_limit(hdrlen + len);
+		}
+	}
+
+	if (nk->acked < opts.nak_receivers)
+		err_msg("only %u of %u receivers confirmed the complete file",
+				nk->acked, opts.nak_receivers);
+
+	close(fb_fd);
+	free(buf);
+	free(want);
+}
+
+
+/* Forward error correction (-F): the code is announced before the
+** data, the parity datagrams of a block follow its last data datagram.
+*/
+#define	FEC_ANNOUNCE_COPIES 3
+
+static void fec_send(int connected_fd, unsigned long long seq, uint16_t seg,
+		uint16_t flags, const struct ns_fec *fec, const void *data, size_t len)
+{
+	struct ns_seq hdr;
+	struct timespec ts;
+	struct iovec iov[3];
+	struct msghdr mh;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	seq_hdr_fill(&hdr, seq, seg, flags, &ts);
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *) fec;
+	iov[1].iov_len = sizeof(*fec);
+	iov[2].iov_base = (void *) data;
+	iov[2].iov_len = len;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = len ? 3 : 2;
+
+	if (sendmsg(connected_fd, &mh, 0) < 0)
+		err_sys("Could not send fec datagram");
+	rate_limit(sizeof(hdr) + sizeof(*fec) + len);
+}
+
+
+static void fec_announce(int connected_fd, uint16_t seg)
+{
+	struct ns_fec fec = {
+		.type = opts.fec.type, .n = opts.fec.n, .k = opts.fec.k,
+	};
+	int i;
+
+	for (i = 0; i < FEC_ANNOUNCE_COPIES; i++)
+		fec_send(connected_fd, 0, seg, NS_SEQ_FEC, &fec, NULL, 0);
+}
+
+
+static void fec_send_parity(int connected_fd, struct fec_tx *tx, struct net_stat *ns)
 {
-	const char *bufptr = buf;
-	ssize_t total = 0;
-	do {
-		ssize_t written = sock_callbacks.cb_write(fd, bufptr, len);
-		net_stat.total_tx_calls += 1;
-		if (written < 0) {
-			int real_errno;
+	struct ns_fec fec = {
+		.type = tx->code.type, .n = tx->code.n, .k = tx->code.k,
+		.count = htons(tx->count), .tail_len = htons(tx->tail_len),
+	};
+	/* a block of one short datagram has a short parity */
+	size_t len = tx->count == 1 ? tx->tail_len : tx->seg;
+	unsigned int i;
+
+	for (i = 0; i < tx->code.k; i++) {
+		fec.index = i;
+		fec_send(connected_fd, tx->block, tx->seg, NS_SEQ_PARITY, &fec,
+				tx->parity[i], len);
+		ns->fec.parity++;
+	}
+	fec_tx_next(tx);
+}
 
-			if (errno == EINTR || errno == EAGAIN)
-				continue;
 
-			real_errno = errno;
-			err_msg("Could not write %u bytes: %s", len, strerror(errno));
-			if (opts.protocol == IPPROTO_SCTP && real_errno == EMSGSIZE) {
-				err_msg("for SCTP the maximum size of data that can be sent in a "
-					"single send call is limited by SO_SNDBUF.\n"
-					"Either increase send buffer size (-s SO_SNDBUF) or "
-					"lower the write buffer size (-b)");
+static ssize_t trans_rw_mmsg(int file_fd, int connected_fd, struct stream_desc *sd,
+		size_t buflen)
+{
+	unsigned int i, nmsg, sent, batch = opts.mmsg_batch ? opts.mmsg_batch : 1;
+	const size_t hdrlen = opts.udp_seq ? sizeof(struct ns_seq) : 0;
+	/* a parity datagram carries a struct ns_fec on top of the payload,
+	 * both kinds of datagrams must fit into buflen */
+	const size_t fec_len = opts.fec.type != FEC_NONE ? sizeof(struct ns_fec) : 0;
+	const size_t payload = buflen - hdrlen - fec_len;
+	unsigned long long seq = 0;
+	struct net_stat *ns = sd->ns;
+	struct ns_seq *hdr = NULL;
+	struct fec_tx fec;
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	struct timespec ts;
+	unsigned char *buf;
+	ssize_t cnt;
+	off_t done = 0;
+	int ret = 0;
+
+	if (buflen <= hdrlen + fec_len)
+		err_msg_die(EXIT_FAILOPT, "buffer size %zu leaves no room for data", buflen);
+
+	/* repairs are read again from the file */
+	if (opts.nak_receivers) {
+		struct stat st;
+
+		xfstat(file_fd, &st, opts.infile);
+		if (!S_ISREG(st.st_mode))
+			err_msg_die(EXIT_FAILOPT, "reliable multicast (-R) requires a regular input file");
+	}
+
+	msg(STRESSFUL, "send via sendmmsg io operation (%u datagrams of %zu byte per call)",
+			batch, buflen);
+
+	buf  = xmemalign(DIRECT_IO_ALIGN, batch * payload);
+	iov  = xmalloc(2 * batch * sizeof(*iov));
+	msgs = xzalloc(batch * sizeof(*msgs));
+	if (hdrlen)
+		hdr = xmalloc(batch * sizeof(*hdr));
+
+	/* iov[2i] is the sequence header, iov[2i + 1] the data of datagram i */
+	for (i = 0; i < batch; i++) {
+		iov[2 * i].iov_base = hdr + i;
+		iov[2 * i].iov_len = hdrlen;
+		iov[2 * i + 1].iov_base = buf + i * payload;
+		msgs[i].msg_hdr.msg_iov = hdrlen ? &iov[2 * i] : &iov[2 * i + 1];
+		msgs[i].msg_hdr.msg_iovlen = hdrlen ? 2 : 1;
+	}
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	if (opts.fec.type != FEC_NONE) {
+		fec_tx_init(&fec, &opts.fec, payload);
+		fec_announce(connected_fd, payload);
+	}
+
+	while ((cnt = slice_read(file_fd, buf, sd, done, batch * payload)) > 0) {
+
+		/* cut the chunk into datagrams */
+		for (nmsg = 0; (size_t) cnt > nmsg * payload; nmsg++)
+			iov[2 * nmsg + 1].iov_len = min((size_t) cnt - nmsg * payload, payload);
+
+		if (hdrlen) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			for (i = 0; i < nmsg; i++)
+				seq_hdr_fill(&hdr[i], seq + i, payload, 0, &ts);
+		}
 
+		for (sent = 0; sent < nmsg; sent += ret) {
+			ret = sendmmsg(connected_fd, msgs + sent, nmsg - sent, 0);
+			ns->total_tx_calls++;
+			if (ret < 0) {
+				if (errno == EINTR || errno == EAGAIN) {
+					ret = 0;
+					continue;
+				}
+				err_sys("Could not send %u datagrams", nmsg - sent);
+				break;
 			}
-			errno = real_errno;
-			break;
+			for (i = sent; i < sent + (unsigned int) ret; i++) {
+				ns->total_tx_bytes += iov[2 * i + 1].iov_len;
+				rate_limit(hdrlen + iov[2 * i + 1].iov_len);
+
+				if (opts.fec.type == FEC_NONE)
+					continue;
+				fec_tx_add(&fec, iov[2 * i + 1].iov_base, iov[2 * i + 1].iov_len);
+				if (fec.count == fec.code.n)
+					fec_send_parity(connected_fd, &fec, ns);
+			}
+			ns->total_tx_msgs += ret;
 		}
-		total += written;
-		bufptr += written;
-		len -= written;
-	} while (len > 0);
+		/* the end marker announces only the datagrams which went out */
+		seq += sent;
+		if (ret < 0)
+			break;
+		done += cnt;
 
-	return total > 0 ? total : -1;
+		/* if we reached a user transfer limit? */
+		if (opts.multiple_barrier && ns->total_tx_bytes >= tx_barrier())
+			break;
+	}
+
+	if (opts.fec.type != FEC_NONE) {
+		if (fec.count)
+			fec_send_parity(connected_fd, &fec, ns);
+		fec_tx_free(&fec);
+	}
+
+	if (opts.nak_receivers && ret >= 0)
+		nak_repair(connected_fd, file_fd, sd, seq, payload);
+
+	if (hdrlen)
+		seq_send_end(connected_fd, seq, payload);
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	if (cnt < 0)
+		err_sys("Can't read %s", opts.infile);
+
+	free(hdr);
+	free(msgs);
+	free(iov);
+	free(buf);
+
+	return ret < 0 ? -1 : (ssize_t) ns->total_tx_bytes;
 }
 
 
-static ssize_t trans_rw(int file_fd, int connected_fd)
+static ssize_t trans_rw(int file_fd, int connected_fd, struct stream_desc *sd)
 {
 	int buflen;
 	ssize_t cnt, cnt_coll = 0;
-	unsigned char *buf;
+	unsigned char *buf, *chunk;
+	off_t done = 0;
+	struct net_stat *ns = sd->ns;
+	struct zc_state zc;
+	bool use_zc = false;
+	unsigned int nbuf = 1, n;
+	uint32_t *buf_id = NULL;
+	struct chunk_tuner tuner;
 
 	msg(STRESSFUL, "send via read/write io operation");
 
 	/* user option or default */
 	buflen = opts.buffer_size ? opts.buffer_size : DEFAULT_BUFSIZE;
+	/* UDP GSO: a write carries as many segments as possible */
+	if (ns->gso_size)
+		buflen = UDP_GSO_BUFLEN(ns->gso_size);
+	buflen = direct_buflen(buflen);
 
-	buf = xmalloc(buflen);
 	if (opts.change_mem_advise &&
-		posix_fadvise(file_fd, 0, 0, get_mem_adv_f(opts.mem_advice))) {
+		posix_fadvise(file_fd, sd->offset, sd->size, get_mem_adv_f(opts.mem_advice))) {
 		err_sys("posix_fadvise");	/* do not exit */
 	}
 
-	touch_use_stat(TOUCH_BEFORE_OP, &net_stat.use_stat_start);
+	if (sd->offset && lseek(file_fd, sd->offset, SEEK_SET) == -1)
+		err_sys_die(EXIT_FAILMISC, "Can't seek to offset %lld of %s",
+				(long long) sd->offset, opts.infile);
+
+	if (opts.io_flags & IOF_PIPELINE)
+		return trans_rw_pipeline(file_fd, connected_fd, sd, buflen);
+
+	if (opts.mmsg_batch || opts.udp_seq)
+		return trans_rw_mmsg(file_fd, connected_fd, sd, buflen);
+
+	/* zero copy buffers are in use until the completion arrives,
+	** therefore cycle through io_depth buffers */
+	if (opts.io_flags & IOF_ZEROCOPY)
+		use_zc = zc_init(&zc, connected_fd, ns);
+	if (use_zc) {
+		nbuf = opts.io_depth;
+		buf_id = xzalloc(nbuf * sizeof(*buf_id));
+	}
+
+	/* the tuner needs a buffer for the largest candidate */
+	tuner_init(&tuner, use_zc ? 0 : TUNER_MAX_CHUNK, buflen, ns);
+	if (tuner.active)
+		buflen = tuner_sizes[tuner.n - 1];
+
+	buf = xmemalign(DIRECT_IO_ALIGN, (size_t) buflen * nbuf);
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	for (n = 0; ; n++) {
+		chunk = buf + (size_t) (n % nbuf) * buflen;
+		if (use_zc && n >= nbuf)
+			zc_wait(&zc, buf_id[n % nbuf]);
+
+		cnt = slice_read(file_fd, chunk, sd, done, tuner.chunk);
+		if (cnt <= 0)
+			break;
 
-	while ((cnt = read(file_fd, buf, buflen)) > 0) {
-		cnt_coll = write_len(connected_fd, buf, cnt);
+		if (use_zc) {
+			cnt_coll = write_len_zc(&zc, chunk, cnt);
+			buf_id[n % nbuf] = zc.next_id - 1;
+		} else {
+			cnt_coll = write_len(connected_fd, chunk, cnt, ns);
+		}
 		if (cnt_coll == -1)
 			break;
 		/* correct statistics */
-		net_stat.total_tx_bytes += cnt_coll;
+		ns->total_tx_bytes += cnt_coll;
+		done += cnt_coll;
+		tuner_account(&tuner, cnt_coll);
 
 		/* if we reached a user transfer limit? */
-		if (opts.multiple_barrier) {
-			unsigned long long limit = buflen * opts.multiple_barrier;
-			if (net_stat.total_tx_bytes >= limit)
-				break;
-		}
+		if (opts.multiple_barrier && ns->total_tx_bytes >= tx_barrier())
+			break;
 	}
 
-	touch_use_stat(TOUCH_AFTER_OP, &net_stat.use_stat_end);
+	if (use_zc)
+		zc_finish(&zc);
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
 
+	tuner_finish(&tuner);
+	free(buf_id);
 	free(buf);
 
 	return cnt_coll;
 }
 
 
-static ssize_t trans_mmap(int file_fd, int connected_fd)
+#ifndef MADV_COLD
+# define MADV_COLD 20
+#endif
+
+/* advise a freshly mapped window: sequential access, start
+** paging in now and use huge pages if the file system can */
+static void mmap_advise_window(void *addr, size_t len)
 {
-	int ret = 0;
-	ssize_t rc, written = 0, write_cnt;
+	if (madvise(addr, len, MADV_HUGEPAGE))
+		msg(STRESSFUL, "no huge pages for %s: %s", opts.infile, strerror(errno));
+
+	if (opts.change_mem_advise) {
+		if (posix_madvise(addr, len, get_mem_adv_m(opts.mem_advice)))
+			err_sys("posix_madvise");	/* do not exit */
+		return;
+	}
+
+	if (madvise(addr, len, MADV_SEQUENTIAL) || madvise(addr, len, MADV_WILLNEED))
+		err_sys("madvise");	/* do not exit */
+}
+
+
+/* Large files are not mapped at once: a window of opts.mmap_window
+** bytes slides over the slice. The next window is read ahead while
+** the current one is sent, pages behind the send cursor are dropped
+** from the process (MADV_DONTNEED) and moved to the inactive list
+** (MADV_COLD) - so RSS and page cache pressure stay bounded.
+*/
+static ssize_t trans_mmap(int file_fd, int connected_fd, struct stream_desc *sd)
+{
+	ssize_t rc = 0, write_cnt;
+	off_t map_offset, map_len, size, window, pos, end, written = 0;
+	off_t delta, len, done, released, release_step;
+	off_t pagesize = getpagesize();
 	struct stat stat_buf;
-	void *mmap_buf;
+	char *mmap_buf;
+	struct net_stat *ns = sd->ns;
+	struct zc_state zc;
+	bool use_zc = false;
 
 	msg(STRESSFUL, "send via mmap/write io operation");
 
-	xfstat(file_fd, &stat_buf, opts.infile);
+	if (opts.io_flags & IOF_ZEROCOPY)
+		use_zc = zc_init(&zc, connected_fd, ns);
 
-	net_stat.total_tx_bytes = 0;
-	touch_use_stat(TOUCH_BEFORE_OP, &net_stat.use_stat_start);
+	xfstat(file_fd, &stat_buf, opts.infile);
 
-	mmap_buf = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, file_fd, 0);
-	if (mmap_buf == MAP_FAILED)
-		err_sys_die(EXIT_FAILMISC, "Can't mmap file %s: %s\n",
-				opts.infile, strerror(errno));
+	size = sd->size ? sd->size : stat_buf.st_size - sd->offset;
+	end = sd->offset + size;
 
-	if (opts.change_mem_advise &&
-		posix_madvise(mmap_buf, stat_buf.st_size, get_mem_adv_m(opts.mem_advice)))
-		err_sys("posix_madvise");	/* do not exit */
+	window = opts.mmap_window ? opts.mmap_window : DEFAULT_MMAP_WINDOW;
+	window = (window + pagesize - 1) & ~(pagesize - 1);
+	release_step = max(window / 8, (off_t) 1024 * 1024);
 
 	/* full or partial write */
 	write_cnt = opts.buffer_size ?
-		opts.buffer_size : stat_buf.st_size;
+		opts.buffer_size : min(size, window);
 
-	/* write chunked sized frames */
-	while (stat_buf.st_size - written >= write_cnt) {
-		char *tmpbuf = mmap_buf;
-		rc = write_len(connected_fd, tmpbuf + written, write_cnt);
-		if (rc == -1)
-			goto write_fail;
-		written += rc;
-	}
-	/* and write remaining bytes, if any */
-	write_cnt = stat_buf.st_size - written;
-	if (write_cnt > 0) {
-		char *tmpbuf = mmap_buf;
-		rc = write_len(connected_fd, tmpbuf + written, write_cnt);
-		if (rc == -1) {
- write_fail:
-			touch_use_stat(TOUCH_AFTER_OP, &net_stat.use_stat_end);
-			net_stat.total_tx_bytes = written;
-			return munmap(mmap_buf, stat_buf.st_size);
+	msg(LOUDISH, "mmap window %lld byte", (long long) window);
+
+	ns->total_tx_bytes = 0;
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	for (pos = sd->offset; pos < end; pos += len) {
+
+		/* mmap offsets must be page aligned, slices need not */
+		map_offset = pos & ~(pagesize - 1);
+		map_len = min(window, end - map_offset);
+		delta = pos - map_offset;
+		len = map_len - delta;
+
+		mmap_buf = mmap(NULL, map_len, PROT_READ, MAP_SHARED, file_fd, map_offset);
+		if (mmap_buf == MAP_FAILED)
+			err_sys_die(EXIT_FAILMISC, "Can't mmap file %s: %s\n",
+					opts.infile, strerror(errno));
+
+		mmap_advise_window(mmap_buf, map_len);
+
+		/* read ahead the next window while this one is sent */
+		if (map_offset + map_len < end &&
+			posix_fadvise(file_fd, map_offset + map_len,
+				min(window, end - map_offset - map_len), POSIX_FADV_WILLNEED))
+			err_sys("posix_fadvise");	/* do not exit */
+
+		for (done = 0, released = 0; done < len; done += rc) {
+			ssize_t cnt = min((off_t) write_cnt, len - done);
+
+			rc = use_zc ? write_len_zc(&zc, mmap_buf + delta + done, cnt) :
+				write_len(connected_fd, mmap_buf + delta + done, cnt, ns);
+			if (rc == -1)
+				break;
+
+			/* release the pages behind the send cursor */
+			if (delta + done + rc - released >= release_step) {
+				off_t upto = (delta + done + rc) & ~(pagesize - 1);
+
+				madvise(mmap_buf + released, upto - released, MADV_COLD);
+				madvise(mmap_buf + released, upto - released, MADV_DONTNEED);
+				released = upto;
+			}
 		}
-		written += rc;
+		written += done;
+
+		/* the kernel may still reference the mapping */
+		if (use_zc)
+			zc_finish(&zc);
+
+		if (munmap(mmap_buf, map_len) == -1)
+			err_sys("Can't munmap buffer");
+
+		if (rc == -1)
+			break;
 	}
 
-	touch_use_stat(TOUCH_AFTER_OP, &net_stat.use_stat_end);
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
 
-	if (stat_buf.st_size != written) {
+	if (size != written) {
 		fprintf(stderr, "ERROR: Can't flush buffer within write call: %s!\n",
 				strerror(errno));
-		fprintf(stderr, " size: %ld written %zd\n", (long)stat_buf.st_size, written);
+		fprintf(stderr, " size: %ld written %ld\n", (long)size, (long)written);
 	}
 
-	ret = munmap(mmap_buf, stat_buf.st_size);
-	if (ret == -1)
-		err_sys("Can't munmap buffer");
-
 	/* correct statistics */
-	net_stat.total_tx_bytes = stat_buf.st_size;
+	ns->total_tx_bytes = written;
 
 	return rc;
 }
 
 #ifdef HAVE_SPLICE
-static long splice_chunk(int pipe_fd, int fd_out, size_t len, int flags)
+
+#ifndef F_SETPIPE_SZ
+# define F_SETPIPE_SZ 1031
+#endif
+#ifndef F_GETPIPE_SZ
+# define F_GETPIPE_SZ 1032
+#endif
+
+#define	DEFAULT_PIPE_SIZE 65536
+
+/* the upper limit for unprivileged pipe sizes */
+static int pipe_max_size(void)
+{
+	FILE *fp;
+	int size = 0;
+
+	fp = fopen("/proc/sys/fs/pipe-max-size", "r");
+	if (fp) {
+		if (fscanf(fp, "%d", &size) != 1)
+			size = 0;
+		fclose(fp);
+	}
+	return size > 0 ? size : DEFAULT_PIPE_SIZE;
+}
+
+
+/* grow the pipe to the user chosen size or to pipe-max-size. The
+** kernel rounds up to a power of two pages and may refuse large
+** pipes (per user limits), then we halve the size. Return the
+** pipe size we got. The splice receiver uses it as well.
+*/
+int grow_pipe(int pipe_fd)
+{
+	int want = opts.pipe_size ? opts.pipe_size : pipe_max_size();
+	int size;
+
+	while (fcntl(pipe_fd, F_SETPIPE_SZ, want) < 0) {
+		msg(LOUDISH, "can't set pipe size to %d byte: %s", want, strerror(errno));
+		if (want <= DEFAULT_PIPE_SIZE)
+			break;
+		want /= 2;
+	}
+
+	size = fcntl(pipe_fd, F_GETPIPE_SZ);
+	if (size <= 0)
+		size = DEFAULT_PIPE_SIZE;
+
+	msg(LOUDISH, "splice pipe size %d byte", size);
+	return size;
+}
+
+
+static long splice_chunk(int pipe_fd, int fd_out, size_t len, int flags,
+		struct net_stat *ns)
 {
 	long written, total = 0;
 
@@ -241,184 +1566,567 @@ static long splice_chunk(int pipe_fd, int fd_out, size_t len, int flags)
 			break;
 		}
 
-		net_stat.total_tx_calls++;
+		ns->total_tx_calls++;
+		ns->splice_calls++;
+		rate_limit(written);
 		total += written;
 		len -= written;
         } while (len > 0);
 
-	net_stat.total_tx_bytes += total;
+	ns->total_tx_bytes += total;
 	return total;
 }
 
 
 
 static ssize_t
-ss_splice_frompipe(int pipe_fd, int connected_fd, ssize_t write_cnt)
+ss_splice_frompipe(int pipe_fd, int connected_fd, ssize_t write_cnt,
+		struct net_stat *ns)
 {
 	ssize_t written, total = 0;
 
-	touch_use_stat(TOUCH_BEFORE_OP, &net_stat.use_stat_start);
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
 
 	do {
-		written = splice(pipe_fd, NULL, connected_fd, NULL, write_cnt, SPLICE_F_MOVE|SPLICE_F_MORE);
+		written = splice(pipe_fd, NULL, connected_fd, NULL, rate_chunk(write_cnt),
+				SPLICE_F_MOVE|SPLICE_F_MORE);
 		if (written < 0) {
 			err_sys("Failure in splice from pipe");
 			break;
 		}
-		net_stat.total_tx_calls += 1;
+		ns->total_tx_calls += 1;
+		ns->splice_calls += 1;
+		rate_limit(written);
 		total += written;
         } while (written > 0);
 
-	touch_use_stat(TOUCH_AFTER_OP, &net_stat.use_stat_end);
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
 
-	net_stat.total_tx_bytes = total;
+	ns->total_tx_bytes = total;
 
 	return 0;
 }
 
 
-static ssize_t get_splice_size(int file_fd, struct stat *stat_buf)
+/* a splice moves at most one pipe full of data */
+static ssize_t get_splice_size(struct stat *stat_buf, off_t size, int pipe_size)
 {
 	ssize_t write_cnt;
 
-	xfstat(file_fd, stat_buf, opts.infile);
-
 	if (opts.buffer_size)
 		write_cnt = opts.buffer_size;
 	else if (S_ISREG(stat_buf->st_mode))
-		write_cnt = stat_buf->st_size;
+		write_cnt = size;
 	else
-		write_cnt = 65536;
+		write_cnt = pipe_size;
 
-	if (write_cnt > 65536)
-		write_cnt = 65536;
+	if (write_cnt > pipe_size)
+		write_cnt = pipe_size;
 
-	if (opts.buffer_size > 65536)
-		 msg(STRESSFUL, "reduced splice buffer length to 64k");
+	if (opts.buffer_size > pipe_size)
+		 msg(STRESSFUL, "reduced splice buffer length to pipe size %d", pipe_size);
 
 	return write_cnt;
 }
 #endif
 
 
-static ssize_t trans_splice(int file_fd, int connected_fd)
+static ssize_t trans_splice(int file_fd, int connected_fd, struct stream_desc *sd)
 {
 #ifdef HAVE_SPLICE
 	int pipefds[2];
 	struct stat stat_buf;
-	ssize_t rc, write_cnt;
-	loff_t offset = 0;
+	ssize_t rc = 0, write_cnt;
+	loff_t offset = sd->offset, end;
+	struct net_stat *ns = sd->ns;
+	struct chunk_tuner tuner;
 
 	msg(STRESSFUL, "send via splice io operation");
 
-	write_cnt = get_splice_size(file_fd, &stat_buf);
+	xfstat(file_fd, &stat_buf, opts.infile);
+
+	if (S_ISFIFO(stat_buf.st_mode)) {
+		ns->pipe_size = grow_pipe(file_fd);
+		write_cnt = get_splice_size(&stat_buf, sd->size, ns->pipe_size);
+		return ss_splice_frompipe(file_fd, connected_fd, write_cnt, ns);
+	}
 
-	if (S_ISFIFO(stat_buf.st_mode))
-		return ss_splice_frompipe(file_fd, connected_fd, write_cnt);
+	end = sd->offset + sd->size;
 
 	xpipe(pipefds);
+	ns->pipe_size = grow_pipe(pipefds[1]);
+	write_cnt = get_splice_size(&stat_buf, sd->size, ns->pipe_size);
+	tuner_init(&tuner, ns->pipe_size, write_cnt, ns);
 
-	touch_use_stat(TOUCH_BEFORE_OP, &net_stat.use_stat_start);
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
 
 	/* write chunked sized frames */
-	while (stat_buf.st_size - offset - 1 >= write_cnt) {
+	while (end - offset - 1 >= (write_cnt = rate_chunk(tuner.chunk))) {
 		rc = splice(file_fd, &offset, pipefds[1], NULL, write_cnt, SPLICE_F_MOVE);
 		if (rc == -1)
 			err_sys_die(EXIT_FAILMISC, "Failure in splice to pipe");
-		if (splice_chunk(pipefds[0], connected_fd, rc, SPLICE_F_MOVE|SPLICE_F_MORE) < 0)
+		ns->splice_calls++;
+		if (splice_chunk(pipefds[0], connected_fd, rc, SPLICE_F_MOVE|SPLICE_F_MORE, ns) < 0)
 			goto finish;
+		tuner_account(&tuner, rc);
 	}
 	/* and write remaining bytes, if any */
-	write_cnt = stat_buf.st_size - offset - 1;
+	write_cnt = end - offset - 1;
 	if (write_cnt >= 0) {
 		rc = splice(file_fd, &offset, pipefds[1], NULL, write_cnt + 1, 0);
 		if (rc == -1)
 			err_sys_die(EXIT_FAILMISC, "Failure in splice to pipe");
+		ns->splice_calls++;
 
-		splice_chunk(pipefds[0], connected_fd, rc, SPLICE_F_MOVE);
+		splice_chunk(pipefds[0], connected_fd, rc, SPLICE_F_MOVE, ns);
 	}
  finish:
-	touch_use_stat(TOUCH_AFTER_OP, &net_stat.use_stat_end);
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+	tuner_finish(&tuner);
 
-	if (offset != stat_buf.st_size)
-		err_msg("Incomplete transfer in splice: %d of %ld bytes",
-						offset , stat_buf.st_size);
+	if (offset != end)
+		err_msg("Incomplete transfer in splice: %lld of %lld bytes",
+				(long long) (offset - sd->offset), (long long) sd->size);
 	close(pipefds[0]);
 	close(pipefds[1]);
 	return rc;
 #else
+	(void) file_fd; (void) connected_fd; (void) sd;
 	err_msg_die(EXIT_FAILMISC, "splice support not compiled in");
 #endif
 }
 
-
-static ssize_t trans_sendfile(int file_fd, int connected_fd)
+static ssize_t trans_sendfile(int file_fd, int connected_fd, struct stream_desc *sd)
 {
-	struct stat stat_buf;
-	ssize_t rc, write_cnt;
-	off_t offset = 0;
+	ssize_t rc = 0, write_cnt;
+	off_t offset = sd->offset, end = sd->offset + sd->size;
+	struct net_stat *ns = sd->ns;
+	struct chunk_tuner tuner;
 
 	msg(STRESSFUL, "send via sendfile io operation");
 
-	xfstat(file_fd, &stat_buf, opts.infile);
-
-	if (stat_buf.st_size == 0)
+	if (sd->size == 0)
 		err_msg("%s: empty file", opts.infile);
 
 	/* full or partial write */
 	write_cnt = opts.buffer_size ?
-		opts.buffer_size : stat_buf.st_size;
+		opts.buffer_size : sd->size;
+	tuner_init(&tuner, sd->size, write_cnt, ns);
 
-	touch_use_stat(TOUCH_BEFORE_OP, &net_stat.use_stat_start);
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
 
 	/* write chunked sized frames */
-	while (stat_buf.st_size - offset - 1 >= write_cnt) {
+	while (end - offset - 1 >= (write_cnt = rate_chunk(tuner.chunk))) {
 		rc = sendfile(connected_fd, file_fd, &offset, write_cnt);
 		if (rc == -1)
 			err_sys_die(EXIT_FAILNET, "Failure in sendfile routine");
-		net_stat.total_tx_calls += 1;
+		ns->total_tx_calls += 1;
+		rate_limit(rc);
+		tuner_account(&tuner, rc);
 	}
 	/* and write remaining bytes, if any */
-	write_cnt = stat_buf.st_size - offset - 1;
+	write_cnt = end - offset - 1;
 	if (write_cnt >= 0) {
 		rc = sendfile(connected_fd, file_fd, &offset, write_cnt + 1);
 		if (rc == -1)
 			err_sys_die(EXIT_FAILNET, "Failure in sendfile routine");
-		net_stat.total_tx_calls += 1;
+		ns->total_tx_calls += 1;
+		rate_limit(rc);
 	}
 
-	touch_use_stat(TOUCH_AFTER_OP, &net_stat.use_stat_end);
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+	tuner_finish(&tuner);
 
-	if (offset != stat_buf.st_size)
-		err_msg_die(EXIT_FAILNET, "Incomplete transfer from sendfile: %d of %ld bytes",
-				offset , stat_buf.st_size);
+	if (offset != end)
+		err_msg_die(EXIT_FAILNET, "Incomplete transfer from sendfile: %lld of %lld bytes",
+				(long long) (offset - sd->offset), (long long) sd->size);
 
 	/* correct statistics */
-	net_stat.total_tx_bytes = stat_buf.st_size;
+	ns->total_tx_bytes = sd->size;
 	return rc;
 }
 
 
-void trans_start(int file_fd, int connected_fd)
+#ifdef HAVE_IO_URING
+/* The io_uring engine cuts the slice into buffer sized chunks,
+** chunk n is read into slot n % depth. Reads complete in any
+** order. Sends are submitted as one linked chain of consecutive
+** chunks, only one chain is in flight - so the byte stream on
+** the socket stays ordered. A short send breaks the chain, the
+** remaining chunks are canceled and queued again. With --rate a
+** chain carries at most one burst, every send is charged before
+** it is queued and gets back the charge of what didn't go out.
+*/
+
+#define	URING_OP_READ 1
+#define	URING_OP_SEND 2
+
+enum uring_slot_state {
+	SLOT_FREE = 0,
+	SLOT_READING,
+	SLOT_READY,
+	SLOT_SENDING,
+	SLOT_NOTIF /* sent, but the zero copy buffer is still in use */
+};
+
+struct uring_slot {
+	enum uring_slot_state state;
+	unsigned long long seq; /* < chunk number */
+	char *buf;
+	size_t len;
+	size_t filled;
+	size_t sent;
+	size_t sending; /* < length of the send in flight */
+	unsigned int notifs;
+};
+
+struct uring_ctx {
+	struct uring ring;
+	struct uring_slot *slot;
+	bool fixed_files;
+	bool fixed_bufs;
+	bool zerocopy;
+	int direct_fd; /* < the file while read with O_DIRECT, else -1 */
+	int file_fd;   /* < fd or index into the registered files */
+	int connected_fd;
+	off_t offset;
+	size_t buflen;
+	unsigned int inflight; /* < outstanding completions */
+	unsigned int chain;    /* < sends of the current chain in flight */
+	unsigned int notifs;   /* < outstanding zero copy notifications */
+	struct net_stat *ns;
+};
+
+
+static struct io_uring_sqe *uring_sqe(struct uring_ctx *ctx, int fd, unsigned int op,
+		unsigned int idx)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&ctx->ring);
+
+	if (!sqe)
+		err_msg_die(EXIT_FAILINT, "io_uring submission queue overflow");
+
+	sqe->fd = fd;
+	if (ctx->fixed_files)
+		sqe->flags |= IOSQE_FIXED_FILE;
+	sqe->user_data = ((__u64) op << 32) | idx;
+	ctx->inflight++;
+
+	return sqe;
+}
+
+
+static void uring_prep_read(struct uring_ctx *ctx, unsigned int idx)
+{
+	struct uring_slot *s = &ctx->slot[idx];
+	struct io_uring_sqe *sqe = uring_sqe(ctx, ctx->file_fd, URING_OP_READ, idx);
+
+	sqe->opcode = ctx->fixed_bufs ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->off = ctx->offset + s->seq * ctx->buflen + s->filled;
+	sqe->addr = (unsigned long) (s->buf + s->filled);
+	sqe->len = s->len - s->filled;
+	if (ctx->direct_fd >= 0)
+		sqe->len = DIRECT_ALIGN_UP(sqe->len);
+	sqe->buf_index = idx;
+}
+
+
+static void uring_prep_send(struct uring_ctx *ctx, unsigned int idx, bool link)
+{
+	struct uring_slot *s = &ctx->slot[idx];
+	struct io_uring_sqe *sqe = uring_sqe(ctx, ctx->connected_fd, URING_OP_SEND, idx);
+
+	/* a send cut to a burst ends the chain, see trans_uring() */
+	s->sending = rate_chunk(s->len - s->sent);
+	rate_limit(s->sending);
+
+	sqe->opcode = ctx->zerocopy ? IORING_OP_SEND_ZC : IORING_OP_SEND;
+	sqe->addr = (unsigned long) (s->buf + s->sent);
+	sqe->len = s->sending;
+	sqe->msg_flags = MSG_WAITALL;
+	if (ctx->zerocopy && ctx->fixed_bufs) {
+		sqe->ioprio |= IORING_RECVSEND_FIXED_BUF;
+		sqe->buf_index = idx;
+	}
+#ifdef IORING_SEND_ZC_REPORT_USAGE
+	if (ctx->zerocopy)
+		sqe->ioprio |= IORING_SEND_ZC_REPORT_USAGE;
+#endif
+	if (link)
+		sqe->flags |= IOSQE_IO_LINK;
+
+	s->state = SLOT_SENDING;
+	ctx->chain++;
+}
+
+
+static void uring_complete(struct uring_ctx *ctx, const struct io_uring_cqe *cqe)
+{
+	unsigned int op = cqe->user_data >> 32;
+	struct uring_slot *s = &ctx->slot[cqe->user_data & 0xffffffff];
+
+	ctx->inflight--;
+
+	if (cqe->flags & IORING_CQE_F_NOTIF) {
+#ifdef IORING_SEND_ZC_REPORT_USAGE
+		if (cqe->res & IORING_NOTIF_USAGE_ZC_COPIED)
+			ctx->ns->total_tx_zc_copied++;
+		else
+			ctx->ns->total_tx_zc++;
+#endif
+		ctx->notifs--;
+		if (--s->notifs == 0 && s->state == SLOT_NOTIF)
+			s->state = SLOT_FREE;
+		return;
+	}
+
+	switch (op) {
+	case URING_OP_READ:
+		if (cqe->res < 0) {
+			errno = -cqe->res;
+			err_sys_die(EXIT_FAILMISC, "Can't read %s", opts.infile);
+		}
+		if (cqe->res == 0)
+			err_msg_die(EXIT_FAILMISC, "%s: unexpected end of file", opts.infile);
+		/* O_DIRECT reads whole blocks, beyond the slice end too */
+		s->filled = min(s->filled + cqe->res, s->len);
+		if (s->filled < s->len) {
+			if (ctx->direct_fd >= 0 && s->filled % DIRECT_IO_ALIGN) {
+				direct_drop(ctx->direct_fd);
+				ctx->direct_fd = -1;
+			}
+			uring_prep_read(ctx, cqe->user_data & 0xffffffff);
+		} else
+			s->state = SLOT_READY;
+		break;
+	case URING_OP_SEND:
+		ctx->chain--;
+		if (cqe->flags & IORING_CQE_F_MORE) {
+			ctx->inflight++;
+			ctx->notifs++;
+			s->notifs++;
+		}
+		if (cqe->res == -ECANCELED) {
+			rate_refund(s->sending);
+			break;
+		}
+		if (cqe->res < 0) {
+			errno = -cqe->res;
+			err_sys_die(EXIT_FAILNET, "Failure in io_uring %s",
+					ctx->zerocopy ? "zero copy send" : "send");
+		}
+		s->sent += cqe->res;
+		/* the rest of a short send is charged when it is queued again */
+		rate_refund(s->sending - cqe->res);
+		break;
+	default:
+		err_msg_die(EXIT_FAILINT, "Programmed Failure");
+	}
+}
+
+
+static ssize_t trans_uring(int file_fd, int connected_fd, struct stream_desc *sd)
+{
+	struct uring_ctx ctx;
+	struct uring_slot *s;
+	struct io_uring_cqe *cqe;
+	struct iovec *iov;
+	struct stat stat_buf;
+	unsigned long long nchunks, rd_next = 0, snd_next = 0, k;
+	unsigned int i, depth;
+	int fds[2];
+	off_t size;
+	char *pool;
+	struct net_stat *ns = sd->ns;
+
+	msg(STRESSFUL, "send via io_uring io operation");
+
+	xfstat(file_fd, &stat_buf, opts.infile);
+	if (!S_ISREG(stat_buf.st_mode)) {
+		msg(GENTLE, "io_uring requires a regular input file - fall back to read/write");
+		return trans_rw(file_fd, connected_fd, sd);
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.buflen = direct_buflen(opts.buffer_size ? opts.buffer_size : DEFAULT_BUFSIZE);
+	ctx.direct_fd = opts.io_flags & IOF_DIRECT ? file_fd : -1;
+	ctx.offset = sd->offset;
+	ctx.zerocopy = !!(opts.io_flags & IOF_ZEROCOPY);
+	ctx.ns = ns;
+
+	size = sd->size;
+	if (opts.multiple_barrier)
+		size = min(size, (off_t) ctx.buflen * opts.multiple_barrier);
+
+	nchunks = (size + ctx.buflen - 1) / ctx.buflen;
+	depth = opts.io_depth;
+	if (nchunks < depth)
+		depth = nchunks ? nchunks : 1;
+
+	/* one read and one send per slot */
+	if (uring_init(&ctx.ring, depth * 2,
+				opts.io_flags & IOF_SQPOLL ? IORING_SETUP_SQPOLL : 0) < 0)
+		err_sys_die(EXIT_FAILMISC, "Can't setup io_uring");
+
+	pool = xmemalign(DIRECT_IO_ALIGN, depth * ctx.buflen);
+	ctx.slot = xzalloc(depth * sizeof(*ctx.slot));
+	iov = xmalloc(depth * sizeof(*iov));
+	for (i = 0; i < depth; i++) {
+		ctx.slot[i].buf = pool + i * ctx.buflen;
+		iov[i].iov_base = ctx.slot[i].buf;
+		iov[i].iov_len = ctx.buflen;
+	}
+
+	ctx.fixed_bufs = uring_register_buffers(&ctx.ring, iov, depth) == 0;
+	if (!ctx.fixed_bufs)
+		msg(LOUDISH, "can't register io_uring buffers: %s", strerror(errno));
+
+	fds[0] = file_fd;
+	fds[1] = connected_fd;
+	ctx.fixed_files = uring_register_files(&ctx.ring, fds, 2) == 0;
+	if (ctx.fixed_files) {
+		ctx.file_fd = 0;
+		ctx.connected_fd = 1;
+	} else {
+		msg(LOUDISH, "can't register io_uring files: %s", strerror(errno));
+		ctx.file_fd = file_fd;
+		ctx.connected_fd = connected_fd;
+	}
+
+	msg(LOUDISH, "io_uring: depth %u, chunk %zu byte%s%s%s", depth, ctx.buflen,
+			ctx.fixed_bufs ? ", fixed buffers" : "",
+			opts.io_flags & IOF_SQPOLL ? ", sqpoll" : "",
+			ctx.zerocopy ? ", zero copy" : "");
+
+	if (opts.change_mem_advise &&
+		posix_fadvise(file_fd, sd->offset, size, get_mem_adv_f(opts.mem_advice))) {
+		err_sys("posix_fadvise");	/* do not exit */
+	}
+
+	touch_use_stat(TOUCH_BEFORE_OP, &ns->use_stat_start);
+
+	while (snd_next < nchunks || ctx.notifs) {
+
+		/* read the next chunks into free slots */
+		while (rd_next < nchunks && ctx.slot[rd_next % depth].state == SLOT_FREE) {
+			s = &ctx.slot[rd_next % depth];
+			s->state = SLOT_READING;
+			s->seq = rd_next;
+			s->filled = s->sent = 0;
+			s->len = min((off_t) ctx.buflen, size - (off_t) (rd_next * ctx.buflen));
+			uring_prep_read(&ctx, rd_next % depth);
+			rd_next++;
+		}
+
+		/* chain all consecutive chunks which are ready to send - but
+		 * with --rate not more than one burst, only the first chunk
+		 * may exceed it and is cut to a burst then */
+		if (!ctx.chain) {
+			size_t budget = rate_budget(), queued = 0;
+
+			for (k = snd_next; k < rd_next; k++) {
+				s = &ctx.slot[k % depth];
+				if (s->state != SLOT_READY)
+					break;
+				if (k > snd_next && queued + s->len - s->sent > budget)
+					break;
+				queued += s->len - s->sent;
+			}
+			for (; snd_next + ctx.chain < k; )
+				uring_prep_send(&ctx, (snd_next + ctx.chain) % depth,
+						snd_next + ctx.chain + 1 < k);
+		}
+
+		cqe = uring_peek_cqe(&ctx.ring);
+		if (!cqe && !ctx.inflight)
+			err_msg_die(EXIT_FAILINT, "Programmed Failure");
+
+		if (uring_submit_and_wait(&ctx.ring, cqe ? 0 : 1) < 0)
+			err_sys_die(EXIT_FAILMISC, "Failure in io_uring_enter");
+
+		while ((cqe = uring_peek_cqe(&ctx.ring)) != NULL) {
+			uring_complete(&ctx, cqe);
+			uring_cqe_seen(&ctx.ring);
+		}
+
+		if (ctx.chain)
+			continue;
+
+		/* chain is done - retire all fully sent chunks ... */
+		for (; snd_next < rd_next; snd_next++) {
+			s = &ctx.slot[snd_next % depth];
+			if (s->state != SLOT_SENDING || s->sent < s->len)
+				break;
+			s->state = s->notifs ? SLOT_NOTIF : SLOT_FREE;
+			ns->total_tx_bytes += s->len;
+		}
+		/* ... and queue the remainder of a short send and all canceled ones again */
+		for (k = snd_next; k < rd_next; k++) {
+			if (ctx.slot[k % depth].state == SLOT_SENDING)
+				ctx.slot[k % depth].state = SLOT_READY;
+		}
+	}
+
+	touch_use_stat(TOUCH_AFTER_OP, &ns->use_stat_end);
+
+	ns->total_tx_calls += ctx.ring.enter_calls;
+	ns->total_tx_sqes += ctx.ring.sqes;
+
+	uring_exit(&ctx.ring);
+	free(iov);
+	free(ctx.slot);
+	free(pool);
+
+	return ns->total_tx_bytes;
+}
+#endif /* HAVE_IO_URING */
+
+
+/* transmit the slice described by sd with the user selected io call */
+void trans_stream(int file_fd, int connected_fd, struct stream_desc *sd)
 {
+	rate_init(connected_fd, sd);
+
 	switch (opts.io_call) {
 	case IO_SENDFILE:
-		trans_sendfile(file_fd, connected_fd);
+		trans_sendfile(file_fd, connected_fd, sd);
 		return;
 	case IO_SPLICE:
-		trans_splice(file_fd, connected_fd);
+		trans_splice(file_fd, connected_fd, sd);
 		return;
 	case IO_MMAP:
-		trans_mmap(file_fd, connected_fd);
+		trans_mmap(file_fd, connected_fd, sd);
 		return;
 	case IO_RW:
-		trans_rw(file_fd, connected_fd);
+		trans_rw(file_fd, connected_fd, sd);
 		return;
+	case IO_URING:
+#ifdef HAVE_IO_URING
+		trans_uring(file_fd, connected_fd, sd);
+		return;
+#else
+		err_msg_die(EXIT_FAILMISC, "io_uring support not compiled in");
+#endif
 	}
 	err_msg_die(EXIT_FAILINT, "Programmed Failure");
 }
 
 
+/* transmit the whole input file as one single stream */
+void trans_start(int file_fd, int connected_fd)
+{
+	struct stat stat_buf;
+	struct stream_desc sd = { .index = 0, .count = 1, .ns = &net_stat };
+
+	xfstat(file_fd, &stat_buf, opts.infile);
+	if (S_ISREG(stat_buf.st_mode))
+		sd.size = stat_buf.st_size;
+
+	net_stat.streams = 1;
+	trans_stream(file_fd, connected_fd, &sd);
+}
+
+
 /* Creates our server socket and initialize
 ** options
 */
@@ -513,6 +2221,96 @@ static int init_stream_trans(int ip_protocol)
 }
 
 
+struct stream_thread {
+	pthread_t tid;
+	int ipproto;
+	struct stream_desc sd;
+	struct net_stat ns;
+};
+
+
+/* every stream thread has its own file descriptor (and therefore
+** its own file position) and its own connection to the peer
+*/
+static void *stream_thread_main(void *arg)
+{
+	struct stream_thread *st = arg;
+	int connected_fd, file_fd;
+
+	file_fd = open_input_file();
+	connected_fd = init_stream_trans(st->ipproto);
+
+	if (st->sd.index == 0)
+		get_sock_opts(connected_fd, &st->ns);
+
+	meta_exchange_snd_stream(connected_fd, file_fd, &st->sd);
+
+	trans_stream(file_fd, connected_fd, &st->sd);
+
+	msg(LOUDISH, "stream %u done (%llu bytes)", st->sd.index, st->ns.total_tx_bytes);
+
+	close(connected_fd);
+	close(file_fd);
+	return NULL;
+}
+
+
+/* Cut the input file into opts.threads slices and transmit
+** each slice over its own connection. Slices are page aligned
+** (mmap), so small files are sent with fewer streams than requested.
+*/
+static void trans_parallel(int file_fd, int ipproto)
+{
+	unsigned int i, count;
+	off_t slice, pagesize = getpagesize();
+	struct stat stat_buf;
+	struct stream_thread *st;
+
+	xfstat(file_fd, &stat_buf, opts.infile);
+	if (!S_ISREG(stat_buf.st_mode))
+		err_msg_die(EXIT_FAILOPT, "parallel streams (-P) require a regular input file");
+
+	slice = (stat_buf.st_size + opts.threads - 1) / opts.threads;
+	slice = ((slice + pagesize - 1) / pagesize) * pagesize;
+	if (slice == 0)
+		slice = pagesize;
+	count = (stat_buf.st_size + slice - 1) / slice;
+	if (count == 0)
+		count = 1;
+
+	if (count != opts.threads)
+		msg(GENTLE, "file too small for %ld streams, use %u", opts.threads, count);
+
+	st = xzalloc(count * sizeof(*st));
+
+	for (i = 0; i < count; i++) {
+		int ret;
+
+		st[i].ipproto = ipproto;
+		st[i].sd.index = i;
+		st[i].sd.count = count;
+		st[i].sd.offset = i * slice;
+		st[i].sd.size = min(slice, stat_buf.st_size - st[i].sd.offset);
+		st[i].sd.ns = &st[i].ns;
+
+		msg(LOUDISH, "stream %u: offset %lld, size %lld", i,
+				(long long) st[i].sd.offset, (long long) st[i].sd.size);
+
+		ret = pthread_create(&st[i].tid, NULL, stream_thread_main, &st[i]);
+		if (ret)
+			err_msg_die(EXIT_FAILMISC, "Can't create stream thread: %s", strerror(ret));
+	}
+
+	for (i = 0; i < count; i++) {
+		pthread_join(st[i].tid, NULL);
+		net_stat_merge(&net_stat, &st[i].ns);
+	}
+
+	net_stat.streams = count;
+	free(st);
+}
+
+
 /*
  * initialize server socket
  * fstat and open our sending-file
@@ -527,6 +2325,13 @@ void ip_stream_trans_mode(struct opts *optsp)
 	/* check if the transmitted file is present and readable */
 	file_fd = open_input_file();
 	ipproto = optsp->protocol;
+
+	if (optsp->threads > 1) {
+		trans_parallel(file_fd, ipproto);
+		close(file_fd);
+		return;
+	}
+
 	connected_fd = init_stream_trans(ipproto);
 
 	/* fetch sockopt before the first byte  */
@@ -379,6 +379,457 @@ case10()
   fi
 }
 
+case11()
+{
+  echo -n "TCP parallel streams tests ..."
+
+  L_ERR=0
+  INFILE=$(mktemp /tmp/netsendXXXXXX)
+  OUTFILE=$(mktemp /tmp/netsendXXXXXX)
+  rm -f ${OUTFILE}
+
+  # every stream should get a few pages
+  dd if=/dev/urandom of=${INFILE} bs=65536 count=16 1>/dev/null 2>&1
+
+  R_OPT="tcp receive ${OUTFILE}"
+  T_OPT="-P 4 tcp transmit ${INFILE} localhost"
+
+  ${NETSEND_BIN} ${R_OPT} 1>/dev/null 2>&1 &
+  RPID=$!
+
+  sleep 2
+
+  ${NETSEND_BIN} ${T_OPT} 1>/dev/null 2>&1
+  if [ $? -ne 0 ] ; then
+    L_ERR=1
+  fi
+
+  # wait for receiver and check return code
+  wait $RPID
+  if [ $? -ne 0 ] ; then
+    L_ERR=1
+  fi
+
+  cmp -s ${INFILE} ${OUTFILE} || L_ERR=1
+  rm -f ${INFILE} ${OUTFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case12()
+{
+  echo -n "TCP io_uring tests ..."
+
+  if ! grep -q "define HAVE_IO_URING" config.h ; then
+    echo skipped
+    return
+  fi
+
+  L_ERR=0
+  INFILE=$(mktemp /tmp/netsendXXXXXX)
+  OUTFILE=$(mktemp /tmp/netsendXXXXXX)
+  rm -f ${OUTFILE}
+
+  # more chunks than queue depth, so slots are reused
+  dd if=/dev/urandom of=${INFILE} bs=65536 count=16 1>/dev/null 2>&1
+
+  R_OPT="-u uring:depth=4 -b 16384 tcp receive ${OUTFILE}"
+  T_OPT="-u uring:depth=4 -b 16384 tcp transmit ${INFILE} localhost"
+
+  ${NETSEND_BIN} ${R_OPT} 1>/dev/null 2>&1 &
+  RPID=$!
+
+  sleep 2
+
+  ${NETSEND_BIN} ${T_OPT} 1>/dev/null 2>&1
+  if [ $? -ne 0 ] ; then
+    L_ERR=1
+  fi
+
+  # wait for receiver and check return code
+  wait $RPID
+  if [ $? -ne 0 ] ; then
+    L_ERR=1
+  fi
+
+  cmp -s ${INFILE} ${OUTFILE} || L_ERR=1
+  rm -f ${INFILE} ${OUTFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case13()
+{
+  echo -n "TCP transmit engine tests ..."
+
+  L_ERR=0
+  INFILE=$(mktemp /tmp/netsendXXXXXX)
+  OUTFILE=$(mktemp /tmp/netsendXXXXXX)
+
+  # several chunks for every engine and an unaligned tail
+  dd if=/dev/urandom of=${INFILE} bs=1000 count=1049 1>/dev/null 2>&1
+
+  R_OPT="tcp receive ${OUTFILE}"
+
+  for topt in "-u rw:zc" "-u mmap:zc" "-u rw:pipeline,depth=4" \
+              "-u splice:pipe=1m -b 262144" "-b auto" "-u sendfile -b auto" \
+              "-u splice -b auto" "-u mmap:window=64k" \
+              "-u rw:direct -b 8192" "-u uring:direct -b 8192" "--rate 200m" \
+              "-u uring --rate 200m" ; do
+    case "$topt" in
+    *splice*) grep -q "define HAVE_SPLICE" config.h || continue ;;
+    *uring*) grep -q "define HAVE_IO_URING" config.h || continue ;;
+    esac
+    echo -n "$topt "
+    rm -f ${OUTFILE}
+    T_OPT="$topt tcp transmit ${INFILE} localhost"
+
+    ${NETSEND_BIN} ${R_OPT} 1>/dev/null 2>&1 &
+    RPID=$!
+
+    sleep 2
+
+    ${NETSEND_BIN} ${T_OPT} 1>/dev/null 2>&1
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+    fi
+
+    # wait for receiver and check return code
+    wait $RPID
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+    fi
+
+    cmp -s ${INFILE} ${OUTFILE} || L_ERR=1
+  done
+  rm -f ${INFILE} ${OUTFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case14()
+{
+  echo -n "UDP sendmmsg/recvmmsg tests ..."
+
+  L_ERR=0
+  INFILE=$(mktemp /tmp/netsendXXXXXX)
+  OUTFILE=$(mktemp /tmp/netsendXXXXXX)
+
+  # small enough for the default receive buffer, the last
+  # batch and the last datagram are partially filled
+  dd if=/dev/urandom of=${INFILE} bs=1000 count=50 1>/dev/null 2>&1
+
+  # plain batches over udp and udp-lite, sequenced datagrams (-S)
+  # and repairs (-R)
+  for topt in "udp -M 8" "udplite -M 8" "udp -S -M 8" "udp -S" \
+              "udp -R 1 -M 8" "udp -F rs:8,2 -M 8" ; do
+    echo -n "$topt "
+    rm -f ${OUTFILE}
+    R_OPT="${topt%% *} receive -M 16 ${OUTFILE}"
+    T_OPT="-b 1400 ${topt%% *} transmit ${topt#* } ${INFILE} localhost"
+
+    ${NETSEND_BIN} ${R_OPT} 1>/dev/null 2>&1 &
+    RPID=$!
+
+    sleep 2
+
+    ${NETSEND_BIN} ${T_OPT} 1>/dev/null 2>&1
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+      kill -9 $RPID 1>/dev/null 2>&1
+    fi
+
+    # the receiver stops after the announced data amount
+    # respective the end marker of sequenced datagrams
+    wait $RPID
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+    fi
+
+    cmp -s ${INFILE} ${OUTFILE} || L_ERR=1
+  done
+  rm -f ${INFILE} ${OUTFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case15()
+{
+  echo -n "UDP GSO/GRO tests ..."
+
+  L_ERR=0
+  INFILE=$(mktemp /tmp/netsendXXXXXX)
+  OUTFILE=$(mktemp /tmp/netsendXXXXXX)
+
+  # several super buffers of 1400 byte segments and a short last
+  # segment
+  dd if=/dev/urandom of=${INFILE} bs=1000 count=150 1>/dev/null 2>&1
+
+  T_OPT="-b 1400 udp transmit -G ${INFILE} localhost"
+
+  # segments read in batches respective coalesced by GRO
+  for ropt in "-M 16" "-G" ; do
+    echo -n "$ropt "
+    rm -f ${OUTFILE}
+    R_OPT="udp receive $ropt ${OUTFILE}"
+
+    ${NETSEND_BIN} ${R_OPT} 1>/dev/null 2>&1 &
+    RPID=$!
+
+    sleep 2
+
+    ${NETSEND_BIN} ${T_OPT} 1>/dev/null 2>&1
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+      kill -9 $RPID 1>/dev/null 2>&1
+    fi
+
+    # the receiver stops after the announced data amount
+    wait $RPID
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+    fi
+
+    cmp -s ${INFILE} ${OUTFILE} || L_ERR=1
+  done
+  rm -f ${INFILE} ${OUTFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case16()
+{
+  echo -n "TCP receive engine tests ..."
+
+  L_ERR=0
+  INFILE=$(mktemp /tmp/netsendXXXXXX)
+  OUTFILE=$(mktemp /tmp/netsendXXXXXX)
+
+  # more than one pipe full, mmap window or ring of buffers and an
+  # unaligned tail
+  dd if=/dev/urandom of=${INFILE} bs=1000 count=1049 1>/dev/null 2>&1
+
+  T_OPT="tcp transmit ${INFILE} localhost"
+
+  for ropt in "-u splice -b 16384" "-u mmap:window=64k" "-u rw:pipeline,depth=4" \
+              "-u rw:direct -b 10000" "-u rw:dontcache" "--sync 64k" \
+              "-u rw:zc" ; do
+    case "$ropt" in
+    *splice*) grep -q "define HAVE_SPLICE" config.h || continue ;;
+    *zc*) grep -q "define HAVE_TCP_ZEROCOPY_RECEIVE" config.h || continue ;;
+    esac
+    echo -n "$ropt "
+    rm -f ${OUTFILE}
+    R_OPT="$ropt tcp receive ${OUTFILE}"
+
+    ${NETSEND_BIN} ${R_OPT} 1>/dev/null 2>&1 &
+    RPID=$!
+
+    sleep 2
+
+    ${NETSEND_BIN} ${T_OPT} 1>/dev/null 2>&1
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+    fi
+
+    # wait for receiver and check return code
+    wait $RPID
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+    fi
+
+    cmp -s ${INFILE} ${OUTFILE} || L_ERR=1
+  done
+  rm -f ${INFILE} ${OUTFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+case17()
+{
+  echo -n "TCP busy poll latency test ..."
+
+  L_ERR=0
+  STATFILE=$(mktemp /tmp/netsendXXXXXX)
+
+  ${NETSEND_BIN} --busy-poll 50 tcp receive 1>/dev/null 2>&1 &
+  RPID=$!
+
+  sleep 2
+
+  # one latency line without and one with busy polling
+  ${NETSEND_BIN} --busy-poll 50 -r 100n -T human tcp transmit ${TESTFILE} localhost \
+    1>/dev/null 2>${STATFILE}
+  if [ $? -ne 0 ] ; then
+    L_ERR=1
+  fi
+
+  wait $RPID
+  if [ $? -ne 0 ] ; then
+    L_ERR=1
+  fi
+
+  if [ $(grep -c "^latency:.*100 probes" ${STATFILE}) -ne 2 ] ; then
+    L_ERR=1
+  fi
+  rm -f ${STATFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case18()
+{
+  echo -n "TCP receive daemon test ..."
+
+  L_ERR=0
+  OUTDIR=$(mktemp -d /tmp/netsendXXXXXX)
+
+  ${NETSEND_BIN} -T human tcp receive --daemon ${OUTDIR}/out-%n 1>/dev/null \
+    2>${OUTDIR}/stat &
+  RPID=$!
+
+  sleep 2
+
+  # three concurrent senders, each into its own file
+  TPIDS=""
+  for i in 1 2 3 ; do
+    ${NETSEND_BIN} tcp transmit ${TESTFILE} localhost 1>/dev/null 2>&1 &
+    TPIDS="${TPIDS} $!"
+  done
+  for pid in ${TPIDS} ; do
+    wait $pid || L_ERR=1
+  done
+
+  sleep 1
+  kill -TERM $RPID
+  wait $RPID
+  if [ $? -ne 0 ] ; then
+    L_ERR=1
+  fi
+
+  for i in 1 2 3 ; do
+    cmp -s ${TESTFILE} ${OUTDIR}/out-$i || L_ERR=1
+  done
+  if ! grep -q "^connections:.*3 complete, 0 incomplete" ${OUTDIR}/stat ; then
+    L_ERR=1
+  fi
+  rm -rf ${OUTDIR}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case19()
+{
+  echo -n "FEC encode/erase/decode test ..."
+
+  # loopback never loses a datagram, fec_test erases them
+  ./fec_test 1>/dev/null
+  if [ $? -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
+
+case20()
+{
+  echo -n "UDP receive engine tests ..."
+
+  L_ERR=0
+  INFILE=$(mktemp /tmp/netsendXXXXXX)
+  OUTFILE=$(mktemp /tmp/netsendXXXXXX)
+
+  # datagrams which straddle the receive buffers
+  dd if=/dev/urandom of=${INFILE} bs=1000 count=50 1>/dev/null 2>&1
+
+  T_OPT="-b 1400 udp transmit ${INFILE} localhost"
+
+  for ropt in "-u rw:direct" "-u rw:dontcache" "-u mmap:window=8k" ; do
+    echo -n "$ropt "
+    rm -f ${OUTFILE}
+    R_OPT="$ropt udp receive ${OUTFILE}"
+
+    ${NETSEND_BIN} ${R_OPT} 1>/dev/null 2>&1 &
+    RPID=$!
+
+    sleep 2
+
+    ${NETSEND_BIN} ${T_OPT} 1>/dev/null 2>&1
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+      kill -9 $RPID 1>/dev/null 2>&1
+    fi
+
+    # the receiver stops after the announced data amount, one
+    # which cut datagrams short waits for ever
+    sleep 1
+    kill -9 $RPID 1>/dev/null 2>&1
+    wait $RPID
+    if [ $? -ne 0 ] ; then
+      L_ERR=1
+    fi
+
+    cmp -s ${INFILE} ${OUTFILE} || L_ERR=1
+  done
+  rm -f ${INFILE} ${OUTFILE}
+
+  if [ $L_ERR -ne 0 ] ; then
+    echo failed
+    TEST_FAILED=1
+  else
+    echo passed
+  fi
+}
+
 
 test_af_local()
 {
@@ -432,6 +883,16 @@ case7
 case8
 case9
 case10
+case11
+case12
+case13
+case14
+case15
+case16
+case17
+case18
+case19
+case20
 test_af_local
 
 post
@@ -0,0 +1,313 @@
+/*
+** netsend - a high performance filetransfer and diagnostic tool
+** http://netsend.berlios.de
+**
+**
+** Copyright (C) 2006 - Hagen Paul Pfeifer <hagen@jauu.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#ifdef HAVE_IO_URING
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "global.h"
+#include "uring.h"
+
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+		unsigned min_complete, unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit,
+			min_complete, flags, NULL, 0);
+}
+
+
+static int sys_io_uring_register(int fd, unsigned opcode,
+		const void *arg, unsigned nr_args)
+{
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+/* setup a ring with entries submission slots, flags are
+** the IORING_SETUP_* flags. Return 0 on success or -1 and
+** errno set.
+*/
+int uring_init(struct uring *r, unsigned entries, unsigned flags)
+{
+	struct io_uring_params p;
+	struct uring_sq *sq = &r->sq;
+	struct uring_cq *cq = &r->cq;
+	unsigned i;
+	char *ptr;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+
+	p.flags = flags;
+	if (flags & IORING_SETUP_SQPOLL)
+		p.sq_thread_idle = 1000; /* msec before the kernel thread sleeps */
+
+	r->fd = sys_io_uring_setup(entries, &p);
+	if (r->fd < 0)
+		return -1;
+	r->flags = flags;
+
+	sq->ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq->ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		sq->ring_sz = cq->ring_sz = max(sq->ring_sz, cq->ring_sz);
+
+	sq->ring_ptr = mmap(NULL, sq->ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (sq->ring_ptr == MAP_FAILED)
+		goto err_close;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq->ring_ptr = sq->ring_ptr;
+	} else {
+		cq->ring_ptr = mmap(NULL, cq->ring_sz, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (cq->ring_ptr == MAP_FAILED)
+			goto err_unmap_sq;
+	}
+
+	sq->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->fd, IORING_OFF_SQES);
+	if (sq->sqes == MAP_FAILED)
+		goto err_unmap_cq;
+
+	ptr = sq->ring_ptr;
+	sq->khead         = (unsigned *) (ptr + p.sq_off.head);
+	sq->ktail         = (unsigned *) (ptr + p.sq_off.tail);
+	sq->kflags        = (unsigned *) (ptr + p.sq_off.flags);
+	sq->kring_mask    = (unsigned *) (ptr + p.sq_off.ring_mask);
+	sq->kring_entries = (unsigned *) (ptr + p.sq_off.ring_entries);
+	sq->array         = (unsigned *) (ptr + p.sq_off.array);
+
+	ptr = cq->ring_ptr;
+	cq->khead      = (unsigned *) (ptr + p.cq_off.head);
+	cq->ktail      = (unsigned *) (ptr + p.cq_off.tail);
+	cq->kring_mask = (unsigned *) (ptr + p.cq_off.ring_mask);
+	cq->cqes       = (struct io_uring_cqe *) (ptr + p.cq_off.cqes);
+
+	/* sqes are consumed in order, so the indirection array is static */
+	for (i = 0; i < p.sq_entries; i++)
+		sq->array[i] = i;
+
+	sq->sqe_head = sq->sqe_tail = *sq->ktail;
+
+	return 0;
+
+ err_unmap_cq:
+	if (cq->ring_ptr != sq->ring_ptr)
+		munmap(cq->ring_ptr, cq->ring_sz);
+ err_unmap_sq:
+	munmap(sq->ring_ptr, sq->ring_sz);
+ err_close:
+	i = errno;
+	close(r->fd);
+	errno = i;
+	return -1;
+}
+
+
+void uring_exit(struct uring *r)
+{
+	struct uring_sq *sq = &r->sq;
+	struct uring_cq *cq = &r->cq;
+
+	munmap(sq->sqes, (*sq->kring_entries) * sizeof(struct io_uring_sqe));
+	if (cq->ring_ptr != sq->ring_ptr)
+		munmap(cq->ring_ptr, cq->ring_sz);
+	munmap(sq->ring_ptr, sq->ring_sz);
+	close(r->fd);
+}
+
+
+/* return a zeroed sqe or NULL if the submission queue is full */
+struct io_uring_sqe *uring_get_sqe(struct uring *r)
+{
+	struct uring_sq *sq = &r->sq;
+	struct io_uring_sqe *sqe;
+	unsigned head = __atomic_load_n(sq->khead, __ATOMIC_ACQUIRE);
+
+	if (sq->sqe_tail - head >= *sq->kring_entries)
+		return NULL;
+
+	sqe = &sq->sqes[sq->sqe_tail & *sq->kring_mask];
+	sq->sqe_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+
+/* hand all prepared sqes to the kernel and wait for at least
+** wait_nr completions. With SQPOLL the kernel thread picks up
+** the sqes by itself and the syscall is only required to wake
+** the thread up or to wait for completions. Return the number
+** of submitted sqes or -1 and errno set.
+*/
+int uring_submit_and_wait(struct uring *r, unsigned wait_nr)
+{
+	struct uring_sq *sq = &r->sq;
+	unsigned to_submit = sq->sqe_tail - sq->sqe_head;
+	unsigned flags = 0;
+	int ret;
+
+	if (to_submit) {
+		__atomic_store_n(sq->ktail, sq->sqe_tail, __ATOMIC_RELEASE);
+		sq->sqe_head = sq->sqe_tail;
+		r->sqes += to_submit;
+	}
+
+	if (r->flags & IORING_SETUP_SQPOLL) {
+		/* pairs with the barrier of the sleeping kernel thread */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(sq->kflags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+		else if (!wait_nr)
+			return to_submit;
+	} else if (!to_submit && !wait_nr) {
+		return 0;
+	}
+
+	if (wait_nr)
+		flags |= IORING_ENTER_GETEVENTS;
+
+	do {
+		ret = sys_io_uring_enter(r->fd, to_submit, wait_nr, flags);
+		r->enter_calls++;
+	} while (ret < 0 && errno == EINTR);
+
+	return ret < 0 ? -1 : (int) to_submit;
+}
+
+
+/* return the next completion or NULL, the cqe must be
+** released via uring_cqe_seen() */
+struct io_uring_cqe *uring_peek_cqe(struct uring *r)
+{
+	struct uring_cq *cq = &r->cq;
+	unsigned head = *cq->khead;
+
+	if (head == __atomic_load_n(cq->ktail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return &cq->cqes[head & *cq->kring_mask];
+}
+
+
+void uring_cqe_seen(struct uring *r)
+{
+	struct uring_cq *cq = &r->cq;
+
+	__atomic_store_n(cq->khead, *cq->khead + 1, __ATOMIC_RELEASE);
+}
+
+
+int uring_register_buffers(struct uring *r, const struct iovec *iov, unsigned nr)
+{
+	return sys_io_uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, nr);
+}
+
+
+int uring_register_files(struct uring *r, const int *fds, unsigned nr)
+{
+	return sys_io_uring_register(r->fd, IORING_REGISTER_FILES, fds, nr);
+}
+
+
+/* register a provided buffer ring of entries slots as buffer
+** group bgid. The ring starts empty. Return 0 on success or -1
+** and errno set - e.g. EINVAL for kernels before 5.19.
+*/
+int uring_buf_ring_init(struct uring *r, struct uring_buf_ring *b,
+		unsigned entries, unsigned short bgid)
+{
+	struct io_uring_buf_reg reg;
+	int err;
+
+	memset(b, 0, sizeof(*b));
+
+	/* page aligned, as the kernel requires */
+	b->br = mmap(NULL, entries * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (b->br == MAP_FAILED)
+		return -1;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) b->br;
+	reg.ring_entries = entries;
+	reg.bgid = bgid;
+
+	if (sys_io_uring_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		err = errno;
+		munmap(b->br, entries * sizeof(struct io_uring_buf));
+		errno = err;
+		return -1;
+	}
+
+	b->entries = entries;
+	b->bgid = bgid;
+	return 0;
+}
+
+
+/* hand buffer bid back to the kernel */
+void uring_buf_ring_add(struct uring_buf_ring *b, void *addr, unsigned len,
+		unsigned short bid)
+{
+	struct io_uring_buf *buf = &b->br->bufs[b->tail & (b->entries - 1)];
+
+	buf->addr = (unsigned long) addr;
+	buf->len = len;
+	buf->bid = bid;
+
+	b->tail++;
+	__atomic_store_n(&b->br->tail, b->tail, __ATOMIC_RELEASE);
+}
+
+
+void uring_buf_ring_exit(struct uring *r, struct uring_buf_ring *b)
+{
+	struct io_uring_buf_reg reg;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.bgid = b->bgid;
+	sys_io_uring_register(r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+	munmap(b->br, b->entries * sizeof(struct io_uring_buf));
+}
+
+#endif /* HAVE_IO_URING */
+
+/* vim:set ts=4 sw=4 sts=4 tw=78 ff=unix noet: */
@@ -0,0 +1,79 @@
+#ifndef NETSEND_URING_H_INCLUDE_
+#define NETSEND_URING_H_INCLUDE_
+
+#include "config.h"
+
+#ifdef HAVE_IO_URING
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/* A minimal io_uring wrapper on top of the raw system calls -
+** netsend has no library dependencies and we need only a
+** handful of operations. The submission queue array is mapped
+** 1:1 to the sqe slots at setup time.
+*/
+
+struct uring_sq {
+	unsigned *khead;
+	unsigned *ktail;
+	unsigned *kflags;
+	unsigned *kring_mask;
+	unsigned *kring_entries;
+	unsigned *array;
+	struct io_uring_sqe *sqes;
+	unsigned sqe_head; /* < first sqe not yet handed to the kernel */
+	unsigned sqe_tail; /* < next free sqe */
+	void *ring_ptr;
+	size_t ring_sz;
+};
+
+struct uring_cq {
+	unsigned *khead;
+	unsigned *ktail;
+	unsigned *kring_mask;
+	struct io_uring_cqe *cqes;
+	void *ring_ptr;
+	size_t ring_sz;
+};
+
+struct uring {
+	int fd;
+	unsigned flags;
+	struct uring_sq sq;
+	struct uring_cq cq;
+	/* accounting: syscalls vs. submitted requests */
+	unsigned long long enter_calls;
+	unsigned long long sqes;
+};
+
+/* provided buffer ring: the kernel picks a buffer for every
+** completion of a buffer select request (e.g. a multishot recv)
+** and reports its id in the cqe, the application hands it back
+** after use. entries is a power of two.
+*/
+struct uring_buf_ring {
+	struct io_uring_buf_ring *br;
+	unsigned entries;
+	unsigned short bgid;
+	unsigned short tail; /* < local copy of the ring tail */
+};
+
+int uring_init(struct uring *, unsigned, unsigned);
+void uring_exit(struct uring *);
+struct io_uring_sqe *uring_get_sqe(struct uring *);
+int uring_submit_and_wait(struct uring *, unsigned);
+struct io_uring_cqe *uring_peek_cqe(struct uring *);
+void uring_cqe_seen(struct uring *);
+int uring_register_buffers(struct uring *, const struct iovec *, unsigned);
+int uring_register_files(struct uring *, const int *, unsigned);
+int uring_buf_ring_init(struct uring *, struct uring_buf_ring *, unsigned, unsigned short);
+void uring_buf_ring_add(struct uring_buf_ring *, void *, unsigned, unsigned short);
+void uring_buf_ring_exit(struct uring *, struct uring_buf_ring *);
+
+#endif /* HAVE_IO_URING */
+
+#endif /* NETSEND_URING_H_INCLUDE_ */
+
+/* vim:set ts=4 sw=4 sts=4 tw=78 ff=unix noet: */
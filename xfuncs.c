@@ -55,6 +55,30 @@ xmalloc(size_t size)
 }
 
 
+void *
+xrealloc(void *ptr, size_t size)
+{
+	void *p = realloc(ptr, size);
+
+	if (!p)
+		err_msg_die(EXIT_FAILMEM, "Out of mem: %s!\n", strerror(errno));
+	return p;
+}
+
+
+/* aligned allocation, e.g. for O_DIRECT buffers */
+void *
+xmemalign(size_t alignment, size_t size)
+{
+	void *ptr;
+	int ret = posix_memalign(&ptr, alignment, size);
+
+	if (ret)
+		err_msg_die(EXIT_FAILMEM, "Out of mem: %s!\n", strerror(ret));
+	return ptr;
+}
+
+
 void xgetaddrinfo(const char *node, const char *service,
 		struct addrinfo *hints, struct addrinfo **res)
 {
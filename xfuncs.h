@@ -7,6 +7,8 @@
 #include <sys/socket.h>
 
 void *xmalloc(size_t len);
+void *xrealloc(void *ptr, size_t len);
+void *xmemalign(size_t alignment, size_t len);
 
 static inline void *xzalloc(size_t len)
 {